@@ -0,0 +1,58 @@
+//
+// compile_nary.cpp
+// compile-time benchmark: a long sum built as one n-ary node in a single step by make_nary, with -DAPPENDED
+// as one n-ary node of half the terms extended by the rest in one step, or with -DBINARY_CHAIN by chaining +,
+// which nests Add nodes
+// compile with -DTERMS=<n>; compile_time.py drives both variants
+//
+// some ideas from https://www.youtube.com/watch?v=lPfA4SFojao
+// created using chatgpt and deepseek, improved by Farshid Mossaiby
+//
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include "../symbolic_math.hpp"
+
+#ifndef TERMS
+#define TERMS 250
+#endif
+
+namespace sm = symbolic_math;
+
+template <std::size_t I>
+constexpr auto term()
+{
+  return sm::Ordered_Symbol<I>{} * double(I + 1);
+}
+
+template <std::size_t... I>
+constexpr auto sum(std::index_sequence<I...>)
+{
+#if defined(BINARY_CHAIN)
+  return (term<0>() + ... + term<I + 1>());
+#elif defined(APPENDED)
+  return []<std::size_t... H, std::size_t... J>(std::index_sequence<H...>, std::index_sequence<J...>)
+  { return sm::make_nary<sm::AddN>(sm::make_nary<sm::AddN>(term<H>()...), term<TERMS / 2 + J>()...); }(
+      std::make_index_sequence<TERMS / 2>{}, std::make_index_sequence<TERMS - TERMS / 2>{});
+#else
+  return sm::make_nary<sm::AddN>(term<0>(), term<I + 1>()...);
+#endif
+}
+
+template <std::size_t... I>
+double evaluate(const auto &f, std::index_sequence<I...>)
+{
+  return f.evaluate({(sm::Ordered_Symbol<I>{} = 1.0)...});
+}
+
+constexpr auto f = sum(std::make_index_sequence<TERMS - 1>{});
+
+// compile-time traversals of the whole expression
+static_assert(sm::structural_hash_v<decltype(f)> != 0);
+static_assert(sm::structural_hash(f) != 0);
+
+int main()
+{
+  return evaluate(f, std::make_index_sequence<TERMS>{}) == TERMS * (TERMS + 1) / 2 ? 0 : 1;
+}
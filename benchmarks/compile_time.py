@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+#
+# compile_time.py
+# records compile time, peak compiler memory and object size of the compile-time benchmarks:
+# compile_nary.cpp, and expressions from generate_expressions.py of increasing size and depth
+#
+# usage: compile_time.py [--cxx g++] [--json results.json] [--benchmarks compile_nary generated]
+#                        [--terms 125 250 500 1000] [--sizes 64 256 1024]
+#
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+import generate_expressions
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def compile_once(cxx, flags, source):
+    with tempfile.TemporaryDirectory() as tmp:
+        obj = os.path.join(tmp, "out.o")
+        start = time.perf_counter()
+        process = subprocess.Popen([cxx, *flags, "-c", source, "-o", obj], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        # wait4 reports the resource usage of this compiler process alone
+        _, status, usage = os.wait4(process.pid, 0)
+        seconds = time.perf_counter() - start
+        ok = os.waitstatus_to_exitcode(status) == 0
+        return {
+            "ok": ok,
+            "seconds": round(seconds, 3),
+            "peak_kib": usage.ru_maxrss,
+            "object_bytes": os.path.getsize(obj) if ok else None,
+        }
+
+
+def nary_cases(terms):
+    source = os.path.join(HERE, "compile_nary.cpp")
+    for n in terms:
+        for variant, defines in (("binary", ["-DBINARY_CHAIN"]), ("nary", []), ("appended", ["-DAPPENDED"])):
+            yield {"benchmark": "compile_nary", "variant": variant, "terms": n}, source, [f"-DTERMS={n}", *defines]
+
+
+def generated_cases(sizes, tmp):
+    for n in sizes:
+        for shape in ("chain", "balanced", "nary"):
+            for symbols in ("ordered", "distinct"):
+                source = os.path.join(tmp, f"{shape}_{symbols}_{n}.cpp")
+                with open(source, "w") as f:
+                    f.write(generate_expressions.generate(shape, n, symbols))
+                yield {"benchmark": "generated", "variant": f"{shape}/{symbols}", "terms": n}, source, []
+
+
+def main():
+    parser = argparse.ArgumentParser(description="records compile time, peak compiler memory and object size")
+    parser.add_argument("--cxx", default=os.environ.get("CXX", "g++"))
+    parser.add_argument("--cxxflags", default=os.environ.get("CXXFLAGS", ""))
+    parser.add_argument("--json", help="write results to this file")
+    parser.add_argument("--benchmarks", nargs="+", choices=["compile_nary", "generated"], default=["compile_nary", "generated"])
+    parser.add_argument("--terms", type=int, nargs="+", default=[125, 250, 500, 1000])
+    parser.add_argument("--sizes", type=int, nargs="+", default=[64, 256, 1024])
+    args = parser.parse_args()
+
+    base = ["-std=c++23", "-O1", *args.cxxflags.split()]
+    results = []
+    with tempfile.TemporaryDirectory() as tmp:
+        cases = []
+        if "compile_nary" in args.benchmarks:
+            cases.append(nary_cases(args.terms))
+        if "generated" in args.benchmarks:
+            cases.append(generated_cases(args.sizes, tmp))
+        for case, source, flags in (c for group in cases for c in group):
+            case.update(compile_once(args.cxx, base + flags, source))
+            # a shallow instantiation and constexpr depth shows that nothing recurses per operand
+            case["shallow_depth_ok"] = compile_once(args.cxx, base + flags + ["-ftemplate-depth=64", "-fconstexpr-depth=64"], source)["ok"]
+            results.append(case)
+            print(f"{case['benchmark']:<14} {case['variant']:<18} terms={case['terms']:<6} ok={case['ok']!s:<5} "
+                  f"seconds={case['seconds']:<8} peak_kib={case['peak_kib']!s:<9} object_bytes={case['object_bytes']!s:<9} "
+                  f"depth_64_ok={case['shallow_depth_ok']}", flush=True)
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(results, f, indent=2)
+    # nested chains are expected to fail at the default depth limit once they are deep enough
+    return 0 if all(r["ok"] or r["variant"] in ("binary", "chain/ordered", "chain/distinct") for r in results) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
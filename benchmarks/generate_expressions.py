@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+#
+# generate_expressions.py
+# writes a translation unit with one large symbolic_math expression, like a generated header would
+#
+# usage: generate_expressions.py --shape chain|balanced|nary --size 256 [--symbols ordered|distinct] [-o out.cpp]
+#
+#   chain     left-nested binary nodes, alternating + and -, so the depth grows with the size
+#   balanced  a balanced tree of alternating + and *, so the depth grows with log2 of the size
+#   nary      one flat sum, built by make_nary
+#
+#   ordered   the leaves cycle through 8 Ordered_Symbol types
+#   distinct  every leaf is its own Symbol, i.e. its own lambda type
+#
+
+import argparse
+import os
+import sys
+
+HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "symbolic_math.hpp")
+ORDERED_SYMBOLS = 8
+
+
+def leaves(size, symbols):
+    count = size if symbols == "distinct" else min(size, ORDERED_SYMBOLS)
+    return [f"s{i % count}" for i in range(size)], count
+
+
+def chain(names):
+    text = names[0]
+    for i, name in enumerate(names[1:]):
+        text = f"({text} {'+' if i % 2 == 0 else '-'} {name})"
+    return text
+
+
+def balanced(names, level=0):
+    if len(names) == 1:
+        return names[0]
+    middle = len(names) // 2
+    return f"({balanced(names[:middle], level + 1)} {'+' if level % 2 == 0 else '*'} {balanced(names[middle:], level + 1)})"
+
+
+def nary(names):
+    return f"sm::make_nary<sm::AddN>({', '.join(names)})"
+
+
+SHAPES = {"chain": chain, "balanced": balanced, "nary": nary}
+
+
+def generate(shape, size, symbols="ordered", header=HEADER):
+    names, count = leaves(size, symbols)
+    lines = [
+        "// generated by generate_expressions.py",
+        f"// shape={shape} size={size} symbols={symbols}",
+        "",
+        f'#include "{os.path.abspath(header)}"',
+        "",
+        "namespace sm = symbolic_math;",
+        "",
+    ]
+    for i in range(count):
+        symbol = f"sm::Ordered_Symbol<{i}>" if symbols == "ordered" else "sm::Symbol<>"
+        lines.append(f"constexpr {symbol} s{i};")
+    lines += [
+        "",
+        f"constexpr sm::Expression e = {SHAPES[shape](names)};",
+        "",
+        "double evaluate(const double *v)",
+        "{",
+        "  return e.evaluate({ " + ", ".join(f"s{i} = v[{i}]" for i in range(count)) + " });",
+        "}",
+        "",
+    ]
+    return "\n".join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="writes a translation unit with one large symbolic_math expression")
+    parser.add_argument("--shape", choices=sorted(SHAPES), default="chain")
+    parser.add_argument("--size", type=int, default=256)
+    parser.add_argument("--symbols", choices=["ordered", "distinct"], default="ordered")
+    parser.add_argument("-o", "--output", help="output file, standard output if omitted")
+    args = parser.parse_args()
+
+    source = generate(args.shape, args.size, args.symbols)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(source)
+    else:
+        sys.stdout.write(source)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
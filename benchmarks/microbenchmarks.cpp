@@ -0,0 +1,501 @@
+//
+// microbenchmarks.cpp
+// runtime microbenchmarks: scalar evaluate, binding lookup, symbolic_evaluate, graphs, profiling, batch backends and the executor,
+// and hardware counters of the batch kernels where perf_event_open is permitted
+// build with e.g. g++ -std=c++23 -O3 -march=native microbenchmarks.cpp -o microbenchmarks
+// usage: microbenchmarks [--json results.json] [--repetitions 31] [--filter substring]
+//
+// some ideas from https://www.youtube.com/watch?v=lPfA4SFojao
+// created using chatgpt and deepseek, improved by Farshid Mossaiby
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "../symbolic_math.hpp"
+#include "../symbolic_math_affine.hpp"
+#include "../symbolic_math_autotune.hpp"
+#include "../symbolic_math_executor.hpp"
+#include "../symbolic_math_filter.hpp"
+#include "../symbolic_math_graph.hpp"
+#include "../symbolic_math_grid.hpp"
+#include "../symbolic_math_perf.hpp"
+#include "../symbolic_math_profile.hpp"
+#include "../symbolic_math_reduce.hpp"
+#include "../symbolic_math_tiered.hpp"
+
+namespace sm = symbolic_math;
+
+// harness
+
+// time stamp counter where available; it counts reference cycles, which match core cycles at nominal frequency
+inline std::uint64_t cycle_counter()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+// keeps value alive without letting the compiler see through it
+template <typename T>
+inline void do_not_optimize(const T &value)
+{
+#if defined(__GNUC__)
+  asm volatile("" : : "r,m"(value) : "memory");
+#else
+  static volatile const T *sink;
+  sink = &value;
+#endif
+}
+
+struct Benchmark_Options
+{
+  std::size_t warmup = 3;
+  std::size_t repetitions = 31;
+  std::string filter;
+};
+
+struct Benchmark_Result
+{
+  std::string name;
+  std::size_t elements;
+  double median_ns;
+  double p99_ns;
+  double cycles_per_element;
+};
+
+// runs body, which processes elements items, and reports per-element times over the repetitions
+Benchmark_Result run_benchmark(const Benchmark_Options &options, std::string name, std::size_t elements, const std::function<void()> &body)
+{
+  for (std::size_t i = 0; i < options.warmup; ++i)
+  {
+    body();
+  }
+
+  std::vector<double> nanoseconds(options.repetitions);
+  std::vector<double> cycles(options.repetitions);
+  for (std::size_t i = 0; i < options.repetitions; ++i)
+  {
+    auto start = std::chrono::steady_clock::now();
+    std::uint64_t start_cycles = cycle_counter();
+    body();
+    std::uint64_t stop_cycles = cycle_counter();
+    auto stop = std::chrono::steady_clock::now();
+    nanoseconds[i] = std::chrono::duration<double, std::nano>(stop - start).count() / elements;
+    cycles[i] = static_cast<double>(stop_cycles - start_cycles) / elements;
+  }
+
+  std::sort(nanoseconds.begin(), nanoseconds.end());
+  std::sort(cycles.begin(), cycles.end());
+  std::size_t p99 = std::min(nanoseconds.size() - 1, static_cast<std::size_t>(0.99 * nanoseconds.size()));
+  return Benchmark_Result{std::move(name), elements, nanoseconds[nanoseconds.size() / 2], nanoseconds[p99], cycles[cycles.size() / 2]};
+}
+
+class Benchmark_Suite
+{
+public:
+  explicit Benchmark_Suite(Benchmark_Options options) : options(std::move(options)) {}
+
+  void add(std::string name, std::size_t elements, const std::function<void()> &body)
+  {
+    if (name.find(options.filter) == std::string::npos)
+    {
+      return;
+    }
+    results.push_back(run_benchmark(options, std::move(name), elements, body));
+    const Benchmark_Result &r = results.back();
+    std::cout << std::left << std::setw(40) << r.name << std::right << std::fixed << std::setprecision(2) << std::setw(12) << r.median_ns
+              << " ns" << std::setw(12) << r.p99_ns << " ns p99" << std::setw(10) << r.cycles_per_element << " cycles/element\n";
+  }
+
+  void write_json(std::ostream &out) const
+  {
+    out << "[\n";
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+      const Benchmark_Result &r = results[i];
+      out << "  {\"name\": \"" << r.name << "\", \"elements\": " << r.elements << ", \"median_ns\": " << r.median_ns
+          << ", \"p99_ns\": " << r.p99_ns << ", \"cycles_per_element\": " << r.cycles_per_element << "}"
+          << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "]\n";
+  }
+
+private:
+  Benchmark_Options options;
+  std::vector<Benchmark_Result> results;
+};
+
+// inputs
+
+constexpr std::size_t batch_size = 1 << 16;
+
+std::vector<double> make_column(std::size_t n, double scale)
+{
+  std::vector<double> column(n);
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    column[i] = scale * static_cast<double>(i % 1024) + 0.5;
+  }
+  return column;
+}
+
+// benchmarks
+
+constexpr sm::Ordered_Symbol<0> x;
+constexpr sm::Ordered_Symbol<1> y;
+constexpr sm::Ordered_Symbol<2> z;
+constexpr sm::Constant pi = 3.14159265358979323846;
+
+// the expression from main.cpp
+constexpr sm::Expression f = 2.0 * x + (y - z) / pi;
+
+void scalar_benchmarks(Benchmark_Suite &suite, const std::vector<double> &xs, const std::vector<double> &ys, const std::vector<double> &zs)
+{
+  suite.add("scalar/evaluate", batch_size, [&]
+            {
+              for (std::size_t i = 0; i < batch_size; ++i)
+              {
+                double value = f.evaluate({ x = xs[i], y = ys[i], z = zs[i] });
+                do_not_optimize(value);
+              } });
+}
+
+// a sum of N symbols evaluated with N bindings; each symbol lookup scans the bindings
+template <std::size_t... I>
+void binding_benchmark(Benchmark_Suite &suite, const std::vector<double> &xs, std::index_sequence<I...>)
+{
+  constexpr auto sum = sm::make_nary<sm::AddN>(sm::Ordered_Symbol<I>{}...);
+  suite.add("bindings/symbols=" + std::to_string(sizeof...(I)), batch_size, [&]
+            {
+              for (std::size_t i = 0; i < batch_size; ++i)
+              {
+                double value = sum.evaluate({ (sm::Ordered_Symbol<I>{} = xs[(i + I) % batch_size])... });
+                do_not_optimize(value);
+              } });
+}
+
+template <std::size_t Depth>
+constexpr auto left_chain()
+{
+  if constexpr (Depth == 0)
+  {
+    return x;
+  }
+  else
+  {
+    constexpr auto lhs = left_chain<Depth - 1>();
+    return sm::Add<std::remove_cv_t<decltype(lhs)>, std::remove_cv_t<decltype(y)>>{lhs, y};
+  }
+}
+
+template <std::size_t Depth>
+void symbolic_benchmark(Benchmark_Suite &suite)
+{
+  constexpr auto chain = left_chain<Depth>();
+  constexpr std::size_t repetitions = 64;
+  suite.add("symbolic_evaluate/depth=" + std::to_string(Depth), repetitions, [&]
+            {
+              for (std::size_t i = 0; i < repetitions; ++i)
+              {
+                std::string text = chain.symbolic_evaluate({ x = "x", y = "y" });
+                do_not_optimize(text);
+              } });
+}
+
+void backend_benchmarks(Benchmark_Suite &suite, const std::vector<double> &xs, const std::vector<double> &ys, const std::vector<double> &zs)
+{
+  sm::Graph graph = sm::to_graph(f);
+  suite.add("backend/graph", batch_size, [&]
+            {
+              for (std::size_t i = 0; i < batch_size; ++i)
+              {
+                double value = graph.evaluate({ x = xs[i], y = ys[i], z = zs[i] });
+                do_not_optimize(value);
+              } });
+
+  // the same with the default sampling profile, whose cost over backend/graph is the profiling overhead
+  sm::Graph_Profile profile;
+  suite.add("backend/graph_profiled", batch_size, [&]
+            {
+              for (std::size_t i = 0; i < batch_size; ++i)
+              {
+                double value = sm::evaluate_profiled(graph, { x = xs[i], y = ys[i], z = zs[i] }, profile);
+                do_not_optimize(value);
+              } });
+
+  // the graph lowered to straight-line code, and the tiered graph, which interprets only its first calls
+  sm::Compiled_Graph compiled = sm::compile_graph(graph);
+  suite.add("backend/graph_compiled", batch_size, [&]
+            {
+              for (std::size_t i = 0; i < batch_size; ++i)
+              {
+                double value = compiled.evaluate({ x = xs[i], y = ys[i], z = zs[i] });
+                do_not_optimize(value);
+              } });
+  sm::Tiered_Graph tiered(graph);
+  suite.add("backend/graph_tiered", batch_size, [&]
+            {
+              for (std::size_t i = 0; i < batch_size; ++i)
+              {
+                double value = tiered.evaluate({ x = xs[i], y = ys[i], z = zs[i] });
+                do_not_optimize(value);
+              } });
+
+  // y and z bound to one value each, which the specializing graph folds in behind a guard
+  sm::Tiering_Options specializing_options;
+  specializing_options.specialize = true;
+  sm::Tiered_Graph specializing(graph, specializing_options);
+  suite.add("backend/graph_specialized", batch_size, [&]
+            {
+              for (std::size_t i = 0; i < batch_size; ++i)
+              {
+                double value = specializing.evaluate({ x = xs[i], y = 0.25, z = 0.5 });
+                do_not_optimize(value);
+              } });
+  suite.add("backend/graph_tiered constant y, z", batch_size, [&]
+            {
+              for (std::size_t i = 0; i < batch_size; ++i)
+              {
+                double value = tiered.evaluate({ x = xs[i], y = 0.25, z = 0.5 });
+                do_not_optimize(value);
+              } });
+
+  constexpr auto form = sm::to_affine(f);
+  std::vector<double> result(batch_size);
+  suite.add("backend/affine_scalar", batch_size, [&]
+            {
+              for (std::size_t i = 0; i < batch_size; ++i)
+              {
+                result[i] = form.evaluate({ x = xs[i], y = ys[i], z = zs[i] });
+              }
+              do_not_optimize(result.data()); });
+  suite.add("backend/affine_batch", batch_size, [&]
+            {
+              form.evaluate({ x = xs, y = ys, z = zs }, result);
+              do_not_optimize(result.data()); });
+}
+
+// the column kernels on a non-affine expression, and the executor's choice among them
+void executor_benchmarks(Benchmark_Suite &suite, const std::vector<double> &xs, const std::vector<double> &ys, const std::vector<double> &zs)
+{
+  constexpr auto h = x * y + (y - z) / (x + pi);
+  std::vector<double> result(batch_size);
+  suite.add("executor/scalar", batch_size, [&]
+            {
+              sm::evaluate_columns_scalar(h, { x = xs, y = ys, z = zs }, result);
+              do_not_optimize(result.data()); });
+  suite.add("executor/simd", batch_size, [&]
+            {
+              sm::evaluate_columns_simd(h, { x = xs, y = ys, z = zs }, result);
+              do_not_optimize(result.data()); });
+  const sm::Executor_Thresholds &thresholds = sm::executor_thresholds();
+  suite.add("executor/threaded", batch_size, [&]
+            {
+              sm::evaluate_columns_threaded(h, { x = xs, y = ys, z = zs }, result, thresholds.max_threads);
+              do_not_optimize(result.data()); });
+  for (std::size_t n : {std::size_t{16}, std::size_t{1024}, batch_size})
+  {
+    std::span<double> out(result.data(), n);
+    sm::Execution_Plan plan = sm::plan_execution<decltype(h)>(n, thresholds);
+    suite.add("executor/adaptive n=" + std::to_string(n) + " " + std::string(sm::backend_name(plan.backend)), n, [&]
+              {
+                sm::execute(h, { x = xs, y = ys, z = zs }, out, thresholds);
+                do_not_optimize(out.data()); });
+  }
+
+  // a model over one data column x and parameters y and z; with the parameters uniform, most of it is hoisted
+  constexpr auto model = x * (y * z + y / (z + pi)) + (z * z - y) / (y + pi) - x / (z + pi);
+  std::vector<double> parameter_y(batch_size, 0.25), parameter_z(batch_size, 0.5);
+  suite.add("executor/model columns", batch_size, [&]
+            {
+              sm::evaluate_columns_simd(model, { x = xs, y = parameter_y, z = parameter_z }, result);
+              do_not_optimize(result.data()); });
+  suite.add("executor/model uniform", batch_size, [&]
+            {
+              sm::evaluate_columns_hoisted(model, { y = 0.25, z = 0.5 }, { x = xs }, result);
+              do_not_optimize(result.data()); });
+
+  sm::Kernel_Tuning tuning = sm::autotune(h, batch_size);
+  suite.add("executor/tuned block=" + std::to_string(tuning.block_size) + " threads=" + std::to_string(tuning.threads), batch_size, [&]
+            {
+              sm::execute(h, { x = xs, y = ys, z = zs }, result, thresholds, tuning);
+              do_not_optimize(result.data()); });
+}
+
+// a 16 x 16 x 256 sweep, as the cartesian product materialized into columns and as a loop nest over the axes
+void grid_benchmarks(Benchmark_Suite &suite, const std::vector<double> &xs, const std::vector<double> &ys, const std::vector<double> &zs)
+{
+  constexpr auto swept = (x * x + pi) * (y / (x + pi)) - z / (x * y + pi);
+  constexpr std::size_t nx = 16, ny = 16, nz = 256;
+  std::span<const double> x_axis(xs.data(), nx), y_axis(ys.data(), ny), z_axis(zs.data(), nz);
+  std::vector<double> x_rows(nx * ny * nz), y_rows(nx * ny * nz), z_rows(nx * ny * nz), result(nx * ny * nz);
+  for (std::size_t i = 0; i < result.size(); ++i)
+  {
+    x_rows[i] = x_axis[i / (ny * nz)];
+    y_rows[i] = y_axis[i / nz % ny];
+    z_rows[i] = z_axis[i % nz];
+  }
+  suite.add("grid/materialized", result.size(), [&]
+            {
+              sm::evaluate_columns_simd(swept, { x = x_rows, y = y_rows, z = z_rows }, result);
+              do_not_optimize(result.data()); });
+  suite.add("grid/loop_nest", result.size(), [&]
+            {
+              sm::evaluate_grid(swept, { x = x_axis, y = y_axis, z = z_axis }, result);
+              do_not_optimize(result.data()); });
+}
+
+// sum, minimum and maximum of a batch, from a materialized result column and fused into the kernel
+void reduce_benchmarks(Benchmark_Suite &suite, const std::vector<double> &xs, const std::vector<double> &ys, const std::vector<double> &zs)
+{
+  constexpr auto h = x * y + (y - z) / (x + pi);
+  std::vector<double> result(batch_size);
+  suite.add("reduce/materialized", batch_size, [&]
+            {
+              sm::evaluate_columns_simd(h, { x = xs, y = ys, z = zs }, result);
+              double sums[3] = {sm::pairwise_sum(result.data(), result.size()), *std::min_element(result.begin(), result.end()),
+                                *std::max_element(result.begin(), result.end())};
+              do_not_optimize(sums); });
+  suite.add("reduce/fused", batch_size, [&]
+            {
+              auto sums = sm::reduce_columns(h, { x = xs, y = ys, z = zs }, batch_size, {}, sm::Sum_Sink{}, sm::Min_Sink{}, sm::Max_Sink{});
+              do_not_optimize(sums); });
+}
+
+// the values at about half of the rows, selected by a full result column and a second pass over it, and
+// fused into the kernel
+void filter_benchmarks(Benchmark_Suite &suite, const std::vector<double> &xs, const std::vector<double> &ys, const std::vector<double> &zs)
+{
+  constexpr auto h = x * y + (y - z) / (x + pi);
+  constexpr auto window = x > 128.0 && y > -192.0;
+  std::vector<double> column(batch_size), result(batch_size);
+  suite.add("filter/two_pass", batch_size, [&]
+            {
+              sm::evaluate_columns_simd(h, { x = xs, y = ys, z = zs }, column);
+              std::size_t selected = 0;
+              for (std::size_t i = 0; i < batch_size; ++i)
+              {
+                if (xs[i] > 128.0 && ys[i] > -192.0)
+                {
+                  result[selected++] = column[i];
+                }
+              }
+              do_not_optimize(result.data()); });
+  suite.add("filter/fused", batch_size, [&]
+            {
+              sm::filter_columns(window, h, { x = xs, y = ys, z = zs }, batch_size, result);
+              do_not_optimize(result.data()); });
+}
+
+// ipc and bytes per cycle tell whether a batch kernel is compute or memory bound; the affine form of f,
+// and the column kernels on the non-affine expression of executor_benchmarks
+void counter_report(const Benchmark_Options &options, const std::vector<double> &xs, const std::vector<double> &ys, const std::vector<double> &zs)
+{
+  constexpr auto form = sm::to_affine(f);
+  constexpr auto h = x * y + (y - z) / (x + pi);
+  const std::size_t threads = sm::executor_thresholds().max_threads;
+  std::vector<double> result(batch_size);
+  auto report = [&](const std::string &name, bool inherit, auto &&evaluate)
+  {
+    if (name.find(options.filter) == std::string::npos)
+    {
+      return;
+    }
+    sm::Perf_Event_Group group(inherit);
+    if (!group.available())
+    {
+      std::cout << std::left << std::setw(40) << name << "unavailable: " << group.error() << "\n";
+      return;
+    }
+    sm::Perf_Counters counters;
+    for (std::size_t i = 0; i < options.repetitions; ++i)
+    {
+      counters += evaluate(group);
+      do_not_optimize(result.data());
+    }
+    double elements = static_cast<double>(options.repetitions * batch_size);
+    std::cout << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(2) << std::setw(8) << counters.ipc()
+              << " ipc" << std::setw(8) << counters.bytes_per_cycle() << " bytes/cycle" << std::setw(8)
+              << static_cast<double>(counters.cache_misses) / elements << " cache misses/element" << std::setw(8)
+              << static_cast<double>(counters.branch_misses) / elements << " branch misses/element\n";
+  };
+
+  report("counters/affine_batch", false, [&](sm::Perf_Event_Group &group)
+         { return sm::evaluate_counted(group, form, { x = xs, y = ys, z = zs }, result); });
+  report("counters/simd_batch", false, [&](sm::Perf_Event_Group &group)
+         { return sm::evaluate_counted(group, h, { x = xs, y = ys, z = zs }, result); });
+  report("counters/threaded_batch threads=" + std::to_string(threads), true, [&](sm::Perf_Event_Group &group)
+         { return sm::evaluate_counted_threaded(group, h, { x = xs, y = ys, z = zs }, result, threads); });
+}
+
+int main(int argc, char **argv)
+{
+  Benchmark_Options options;
+  std::string json;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string_view arg = argv[i];
+    if (arg == "--json" && i + 1 < argc)
+    {
+      json = argv[++i];
+    }
+    else if (arg == "--repetitions" && i + 1 < argc)
+    {
+      options.repetitions = std::max<std::size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+    }
+    else if (arg == "--filter" && i + 1 < argc)
+    {
+      options.filter = argv[++i];
+    }
+    else
+    {
+      std::cerr << "usage: " << argv[0] << " [--json results.json] [--repetitions 31] [--filter substring]\n";
+      return 1;
+    }
+  }
+
+  std::vector<double> xs = make_column(batch_size, 0.5);
+  std::vector<double> ys = make_column(batch_size, -0.25);
+  std::vector<double> zs = make_column(batch_size, 2.0);
+
+  Benchmark_Suite suite(options);
+  scalar_benchmarks(suite, xs, ys, zs);
+  binding_benchmark(suite, xs, std::make_index_sequence<1>{});
+  binding_benchmark(suite, xs, std::make_index_sequence<4>{});
+  binding_benchmark(suite, xs, std::make_index_sequence<16>{});
+  binding_benchmark(suite, xs, std::make_index_sequence<64>{});
+  symbolic_benchmark<4>(suite);
+  symbolic_benchmark<16>(suite);
+  symbolic_benchmark<64>(suite);
+  backend_benchmarks(suite, xs, ys, zs);
+  executor_benchmarks(suite, xs, ys, zs);
+  grid_benchmarks(suite, xs, ys, zs);
+  reduce_benchmarks(suite, xs, ys, zs);
+  filter_benchmarks(suite, xs, ys, zs);
+  counter_report(options, xs, ys, zs);
+
+  if (!json.empty())
+  {
+    std::ofstream out(json);
+    suite.write_json(out);
+  }
+  return 0;
+}
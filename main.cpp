@@ -6,8 +6,32 @@
 // created using chatgpt and deepseek, improved by Farshid Mossaiby
 //
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
 #include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 #include "symbolic_math.hpp"
+#include "symbolic_math_affine.hpp"
+#include "symbolic_math_analysis.hpp"
+#include "symbolic_math_autotune.hpp"
+#include "symbolic_math_egraph.hpp"
+#include "symbolic_math_executor.hpp"
+#include "symbolic_math_filter.hpp"
+#include "symbolic_math_graph.hpp"
+#include "symbolic_math_grid.hpp"
+#include "symbolic_math_optimize.hpp"
+#include "symbolic_math_perf.hpp"
+#include "symbolic_math_profile.hpp"
+#include "symbolic_math_reduce.hpp"
+#include "symbolic_math_rewrite.hpp"
+#include "symbolic_math_tiered.hpp"
+#include "symbolic_math_trace.hpp"
 
 int main()
 {
@@ -26,8 +50,517 @@ int main()
   constexpr double expected = 2.0 * 4.0 + (2.0 - 1.0) / 3.14159265358979323846;
   static_assert(result == expected, "result does not match expected value");
 
+  // substitute an expression for a symbol
+  constexpr symbolic_math::Expression g = symbolic_math::substitute(f, x, y * z);
+  static_assert(g.evaluate({ y = 2.0, z = 1.0 }) == 2.0 * (2.0 * 1.0) + (2.0 - 1.0) / 3.14159265358979323846,
+                "substituted result does not match expected value");
+
+  // canonical ordering and structural hashing need symbols with stable ordinals
+  constexpr symbolic_math::Ordered_Symbol<0> a;
+  constexpr symbolic_math::Ordered_Symbol<1> b;
+  constexpr auto ab = symbolic_math::canonicalize(a * b + 2.0);
+  constexpr auto ba = symbolic_math::canonicalize(2.0 + b * a);
+  static_assert(std::is_same_v<decltype(ab), decltype(ba)>, "canonical forms do not match");
+  static_assert(symbolic_math::structural_hash(ab) == symbolic_math::structural_hash(ba), "hashes do not match");
+  static_assert(symbolic_math::structural_hash(a * 2.0) != symbolic_math::structural_hash(a * 3.0),
+                "constant values are not hashed");
+  static_assert(symbolic_math::structural_hash(x / y) != symbolic_math::structural_hash(x / x) &&
+                    symbolic_math::structural_hash_v<decltype(x * y + x)> != symbolic_math::structural_hash_v<decltype(x * y + y)> &&
+                    symbolic_math::structural_hash(x - y) != symbolic_math::structural_hash(x - a),
+                "distinct symbols without an ordinal are not hashed apart");
+
+  // rewrite rules: factor a common left operand and fold nested constant factors
+  using namespace symbolic_math::patterns;
+  constexpr symbolic_math::Rule factor{_1 * _2 + _1 * _3, _1 * (_2 + _3)};
+  constexpr symbolic_math::Rule fold{_c1 * (_c2 * _1), [](const auto &m)
+                                     { return symbolic_math::make_constant(m[_c1].value * m[_c2].value) * m[_1]; }};
+  constexpr auto h = symbolic_math::rewrite(a * b + a * (2.0 * (4.0 * b)), factor, fold);
+  static_assert(std::is_same_v<decltype(h.lhs), symbolic_math::Ordered_Symbol<0>>, "common factor was not extracted");
+  static_assert(h.evaluate({ a = 3.0, b = 5.0 }) == 3.0 * (5.0 + 8.0 * 5.0), "rewritten result does not match expected value");
+  // a binary pattern matches the links of an n-ary chain, as it does the nodes of a graph
+  constexpr auto links = symbolic_math::make_nary<symbolic_math::AddN>(a * b, a * (2.0 * b), symbolic_math::make_constant(1.0));
+  static_assert(symbolic_math::Nary_Node<decltype(links)> && decltype(links)::arity == 3, "sum is not n-ary");
+  constexpr auto factored = symbolic_math::rewrite(links, factor);
+  static_assert(std::is_same_v<decltype(factored.lhs.lhs), symbolic_math::Ordered_Symbol<0>>, "common factor was not extracted from the chain");
+  static_assert(factored.evaluate({ a = 3.0, b = 5.0 }) == links.evaluate({ a = 3.0, b = 5.0 }), "rewritten chain does not match expected value");
+
+  // the same rules, plus value-matched ones, on a runtime graph
+  symbolic_math::Graph graph = symbolic_math::to_graph((x * y + x * (z * 1.0)) - (y - y));
+  symbolic_math::Graph rewritten = symbolic_math::rewrite(graph, {symbolic_math::make_graph_rule(factor),
+                                                                  symbolic_math::make_graph_rule(_1 * 1.0, _1),
+                                                                  symbolic_math::make_graph_rule(_1 - (_2 - _2), _1)});
+  if (rewritten.symbolic_evaluate({ x = "x", y = "y", z = "z" }) != "(x * (y + z))" ||
+      rewritten.evaluate({ x = 4.0, y = 2.0, z = 1.0 }) != graph.evaluate({ x = 4.0, y = 2.0, z = 1.0 }))
+  {
+    std::cerr << "graph rewrite does not match expected result\n";
+    return 1;
+  }
+
+  // equality saturation trades divides for multiplies and factors common terms
+  symbolic_math::Graph quotients = symbolic_math::to_graph(x / y / z + (2.0 * x) / (y * z) + x * y + x * z);
+  symbolic_math::Graph optimized = symbolic_math::optimize(quotients);
+  symbolic_math::Cost_Model costs;
+  if (costs(optimized) >= costs(quotients) ||
+      std::abs(optimized.evaluate({ x = 4.0, y = 2.0, z = 1.0 }) - quotients.evaluate({ x = 4.0, y = 2.0, z = 1.0 })) > 1e-12)
+  {
+    std::cerr << "e-graph optimization does not reduce cost\n";
+    return 1;
+  }
+
+  // the node limit also holds within one iteration, whose distributivity matches alone would exceed it
+  symbolic_math::E_Graph bounded;
+  bounded.add(symbolic_math::to_graph((x + y + z + pi) * (x - y - z - pi) * (y + z + x * pi)));
+  std::size_t node_limit = bounded.node_count() + 3;
+  if (bounded.saturate({node_limit, 1, std::chrono::milliseconds(1000)}) != symbolic_math::Saturation::node_limit ||
+      bounded.node_count() > node_limit + 2)
+  {
+    std::cerr << "e-graph saturation exceeded its node limit\n";
+    return 1;
+  }
+
+  // balanced reassociation of long chains, opt-in through the fast-math policy
+  constexpr symbolic_math::Ordered_Symbol<2> c;
+  constexpr symbolic_math::Ordered_Symbol<3> d;
+  constexpr auto chain = a + b + c + d;
+  constexpr auto balanced = symbolic_math::reassociate<symbolic_math::Math_Policy::fast_math>(chain);
+  static_assert(std::is_same_v<std::remove_cv_t<decltype(balanced)>, symbolic_math::Add<decltype(a + b), decltype(c + d)>>,
+                "chain was not balanced");
+  static_assert(std::is_same_v<decltype(symbolic_math::reassociate<symbolic_math::Math_Policy::exact>(chain)), std::remove_cv_t<decltype(chain)>>,
+                "exact policy must not reassociate");
+  static_assert(balanced.evaluate({ a = 1.0, b = 2.0, c = 3.0, d = 4.0 }) == 10.0, "balanced result does not match expected value");
+
+  // make_nary builds flat n-ary nodes, structurally equal to the nested chains that chained + and * build
+  using A = symbolic_math::Ordered_Symbol<0>;
+  using B = symbolic_math::Ordered_Symbol<1>;
+  using C = symbolic_math::Ordered_Symbol<2>;
+  using D = symbolic_math::Ordered_Symbol<3>;
+  constexpr auto flat = symbolic_math::make_nary<symbolic_math::AddN>(a, b, c, d);
+  static_assert(std::is_same_v<std::remove_cv_t<decltype(chain)>, symbolic_math::Add<symbolic_math::Add<symbolic_math::Add<A, B>, C>, D>>,
+                "chain is not nested");
+  static_assert(symbolic_math::structural_hash(flat) == symbolic_math::structural_hash(chain), "n-ary hash does not match nested chain");
+  static_assert(symbolic_math::structural_compare<decltype(flat), decltype(chain)>() == 0, "n-ary node does not compare equal to nested chain");
+  static_assert(std::is_same_v<decltype(symbolic_math::canonicalize(symbolic_math::make_nary<symbolic_math::MultiplyN>(b, a, c))), symbolic_math::MultiplyN<A, B, C>>,
+                "n-ary operands were not ordered");
+  static_assert(symbolic_math::make_nary<symbolic_math::MultiplyN>(a, b, c, symbolic_math::make_constant(2.0)).evaluate({ a = 1.0, b = 2.0, c = 3.0 }) == 12.0,
+                "n-ary result does not match expected value");
+  static_assert(std::is_same_v<decltype(symbolic_math::make_nary<symbolic_math::AddN>(symbolic_math::make_nary<symbolic_math::AddN>(a, b, c), d)),
+                               std::remove_cv_t<decltype(flat)>>,
+                "n-ary node was not extended in one step");
+
+  // strength reduction; exact rules by default, other reciprocals and shared denominators under fast-math
+  using Reciprocal = decltype(symbolic_math::make_constant(0.0));
+  constexpr auto reduced = symbolic_math::strength_reduce<a / 4.0 + b * 2.0>();
+  static_assert(std::is_same_v<std::remove_cv_t<decltype(reduced)>, symbolic_math::Add<symbolic_math::Multiply<A, Reciprocal>, symbolic_math::Add<B, B>>>,
+                "exact strength reduction was not applied");
+  static_assert(reduced.evaluate({ a = 3.0, b = 5.0 }) == 3.0 / 4.0 + 5.0 * 2.0, "reduced result does not match expected value");
+  static_assert(std::is_same_v<decltype(symbolic_math::strength_reduce<a / 3.0>()), std::remove_cv_t<decltype(a / 3.0)>>,
+                "exact policy must not take inexact reciprocals");
+  static_assert(std::is_same_v<decltype(symbolic_math::strength_reduce<a / 3.0, symbolic_math::Math_Policy::fast_math>()),
+                               symbolic_math::Multiply<A, Reciprocal>>,
+                "fast-math policy did not take the reciprocal");
+  constexpr auto shared = symbolic_math::strength_reduce<a / (b * c) - d / (b * c), symbolic_math::Math_Policy::fast_math>();
+  static_assert(std::is_same_v<std::remove_cv_t<decltype(shared)>, symbolic_math::Divide<symbolic_math::Subtract<A, D>, symbolic_math::Multiply<B, C>>>,
+                "quotients with a shared denominator were not combined");
+  // the value form knows the values of Rational constants, but not of Constant ones
+  constexpr auto reduced_value = symbolic_math::strength_reduce(a / symbolic_math::Rational<4>{} + b * symbolic_math::Rational<2>{});
+  static_assert(std::is_same_v<decltype(reduced_value), decltype(reduced)> && reduced_value.evaluate({ a = 3.0, b = 5.0 }) == reduced.evaluate({ a = 3.0, b = 5.0 }),
+                "exact strength reduction of a value was not applied");
+  static_assert(std::is_same_v<decltype(symbolic_math::strength_reduce(a / 4.0)), std::remove_cv_t<decltype(a / 4.0)>>,
+                "constant of unknown value was strength reduced");
+  static_assert(std::is_same_v<decltype(symbolic_math::strength_reduce<symbolic_math::Math_Policy::fast_math>(a / (b * c) - d / (b * c))),
+                               std::remove_cv_t<decltype(shared)>>,
+                "quotients of a value with a shared denominator were not combined");
+
+  // division minimization under fast-math, checked against first-order rounding error bounds
+  constexpr auto ratios = a / b + c / d;
+  constexpr auto combined = symbolic_math::combine_quotients<symbolic_math::Math_Policy::fast_math>(ratios);
+  static_assert(std::is_same_v<std::remove_cv_t<decltype(combined)>,
+                               symbolic_math::Divide<symbolic_math::Add<symbolic_math::Multiply<A, D>, symbolic_math::Multiply<C, B>>, symbolic_math::Multiply<B, D>>>,
+                "quotients were not combined");
+  static_assert(std::is_same_v<std::remove_cv_t<decltype(symbolic_math::combine_quotients<symbolic_math::Math_Policy::fast_math>(a / b / c + d / (b * c)))>,
+                               symbolic_math::Divide<symbolic_math::Add<A, D>, symbolic_math::Multiply<B, C>>>,
+                "shared denominators were not kept");
+  static_assert(std::is_same_v<decltype(symbolic_math::combine_quotients<symbolic_math::Math_Policy::exact>(ratios)), std::remove_cv_t<decltype(ratios)>>,
+                "exact policy must not combine quotients");
+  constexpr auto before = symbolic_math::error_bound(ratios, { a = 1.0, b = 3.0, c = 2.0, d = 7.0 });
+  constexpr auto after = symbolic_math::error_bound(combined, { a = 1.0, b = 3.0, c = 2.0, d = 7.0 });
+  static_assert(after.bound > 0.0 && after.bound < 1e-15 && symbolic_math::magnitude(before.value - after.value) <= before.bound + after.bound,
+                "combined quotient is outside its error bound");
+  // the guard keeps the combined quotient within tolerance, and rejects it where b * d overflows
+  constexpr auto guarded = symbolic_math::combine_quotients<symbolic_math::Math_Policy::fast_math>(ratios, { a = 1.0, b = 3.0, c = 2.0, d = 7.0 }, 1e-15);
+  static_assert(guarded.accepted && guarded.evaluate({ a = 1.0, b = 3.0, c = 2.0, d = 7.0 }) == after.value, "guard rejected a combined quotient within tolerance");
+  const auto overflowing = symbolic_math::combine_quotients<symbolic_math::Math_Policy::fast_math>(ratios, { a = 1.0, b = 1e200, c = 1.0, d = 1e200 }, 1e-15);
+  if (overflowing.accepted || overflowing.evaluate({ a = 1.0, b = 1e200, c = 1.0, d = 1e200 }) != 2e-200)
+  {
+    std::cerr << "guard did not reject an overflowing quotient\n";
+    return 1;
+  }
+
+  // affine expressions lower to an offset and one coefficient per symbol, evaluated over columns in batches
+  static_assert(symbolic_math::is_affine<decltype(f)>() && !symbolic_math::is_affine<decltype(g)>(), "linearity analysis is wrong");
+  constexpr auto form = symbolic_math::to_affine(f);
+  static_assert(form.coefficients.size() == 3 && form.offset == 0.0 && form.coefficients[0] == 2.0, "affine form is wrong");
+  static_assert(symbolic_math::magnitude(form.evaluate({ x = 4.0, y = 2.0, z = 1.0 }) - expected) < 1e-15, "affine result does not match expected value");
+  std::vector<double> xs(1000), ys(1000), zs(1000), values(1000);
+  for (std::size_t i = 0; i < xs.size(); ++i)
+  {
+    xs[i] = 0.5 * i;
+    ys[i] = 1.0 - 0.25 * i;
+    zs[i] = 3.0;
+  }
+  form.evaluate({ x = xs, y = ys, z = zs }, values);
+  for (std::size_t i = 0; i < values.size(); ++i)
+  {
+    if (values[i] != form.evaluate({ x = xs[i], y = ys[i], z = zs[i] }) ||
+        std::abs(values[i] - f.evaluate({ x = xs[i], y = ys[i], z = zs[i] })) > 1e-12)
+    {
+      std::cerr << "affine batch evaluation does not match expected result\n";
+      return 1;
+    }
+  }
+
+  // hardware counters around the batch; without access to them the batch still runs and reports no counts
+  symbolic_math::Perf_Event_Group counter_group;
+  std::vector<double> counted_values(values.size());
+  symbolic_math::Perf_Counters batch_counters = symbolic_math::evaluate_counted(counter_group, form, { x = xs, y = ys, z = zs }, counted_values);
+  if (counted_values != values || batch_counters.bytes != 4 * values.size() * sizeof(double) ||
+      (batch_counters.available ? batch_counters.instructions == 0 : batch_counters.cycles != 0 || counter_group.error().empty()))
+  {
+    std::cerr << "counted batch evaluation does not match expected result\n";
+    return 1;
+  }
+  // and around the column kernel, on its own thread and on the threads it starts
+  constexpr auto nonlinear = x * y + (y - z) / (x + 1.0);
+  std::vector<double> kernel_values(values.size()), counted_kernel(values.size()), counted_threads(values.size());
+  symbolic_math::evaluate_columns_scalar(nonlinear, { x = xs, y = ys, z = zs }, kernel_values);
+  symbolic_math::Perf_Event_Group thread_group(true);
+  symbolic_math::Perf_Counters kernel_counters = symbolic_math::evaluate_counted(counter_group, nonlinear, { x = xs, y = ys, z = zs }, counted_kernel);
+  symbolic_math::Perf_Counters thread_counters =
+      symbolic_math::evaluate_counted_threaded(thread_group, nonlinear, { x = xs, y = ys, z = zs }, counted_threads, 3);
+  if (counted_kernel != kernel_values || counted_threads != kernel_values || kernel_counters.bytes != 4 * values.size() * sizeof(double) ||
+      thread_counters.bytes != kernel_counters.bytes || kernel_counters.available != batch_counters.available ||
+      (thread_counters.available ? thread_counters.instructions == 0 : thread_counters.cycles != 0 || thread_group.error().empty()))
+  {
+    std::cerr << "counted kernel evaluation does not match expected result\n";
+    return 1;
+  }
+
+  // the executor picks the element loop, the blocked kernel or threads from the static cost and the batch size
+  symbolic_math::Executor_Thresholds thresholds;
+  thresholds.simd_min_operations = 4;
+  thresholds.simd_min_batch = 100;
+  thresholds.threaded_min_work = 1000.0;
+  thresholds.max_threads = 2;
+  std::vector<double> executed(values.size());
+  for (std::size_t n : {std::size_t{10}, std::size_t{300}, values.size()})
+  {
+    std::span<double> out(executed.data(), n);
+    symbolic_math::Execution_Plan plan = symbolic_math::execute(g, { y = ys, z = zs }, out, thresholds);
+    symbolic_math::Backend expected_backend = n < 100 ? symbolic_math::Backend::scalar : n < 1000 ? symbolic_math::Backend::simd : symbolic_math::Backend::threaded;
+    if (plan.backend != expected_backend || plan.counts != symbolic_math::count_operations(g) || plan.describe().empty())
+    {
+      std::cerr << "execution plan does not match expected backend\n";
+      return 1;
+    }
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      if (executed[i] != g.evaluate({ y = ys[i], z = zs[i] }))
+      {
+        std::cerr << "executed result does not match expected value\n";
+        return 1;
+      }
+    }
+  }
+  // without thresholds the uncalibrated ones apply, so nothing is timed and no thread starts
+  if (symbolic_math::execute(g, { y = ys, z = zs }, executed).threads != 1)
+  {
+    std::cerr << "default execution plan does not match uncalibrated thresholds\n";
+    return 1;
+  }
+  // affine expressions take their coefficient form, which rounds differently, only under fast_math
+  symbolic_math::execute(f, { x = xs, y = ys, z = zs }, executed, thresholds);
+  for (std::size_t i = 0; i < executed.size(); ++i)
+  {
+    if (executed[i] != f.evaluate({ x = xs[i], y = ys[i], z = zs[i] }))
+    {
+      std::cerr << "executed affine result does not match expected value\n";
+      return 1;
+    }
+  }
+  symbolic_math::execute<symbolic_math::Math_Policy::fast_math>(f, { x = xs, y = ys, z = zs }, executed, thresholds);
+  if (executed != values)
+  {
+    std::cerr << "affine expression was not executed in coefficient form under fast_math\n";
+    return 1;
+  }
+
+  // the blocked kernel needs one scratch column per level of right operands that are not leaves, at any block size
+  constexpr auto deep = x - y * (z + x / (y - z));
+  static_assert(symbolic_math::Column_Kernel<decltype(deep)>::levels<decltype(deep)>() == 4, "scratch levels do not match expected value");
+  std::vector<double> deep_scalar(values.size()), deep_blocked(values.size());
+  symbolic_math::evaluate_columns_scalar(deep, { x = xs, y = ys, z = zs }, deep_scalar);
+  for (std::size_t block_size : {std::size_t{1}, std::size_t{7}, std::size_t{64}, std::size_t{4096}})
+  {
+    symbolic_math::evaluate_columns_simd(deep, { x = xs, y = ys, z = zs }, deep_blocked, block_size);
+    if (deep_blocked != deep_scalar)
+    {
+      std::cerr << "blocked evaluation does not match expected result at block size " << block_size << "\n";
+      return 1;
+    }
+  }
+
+  // uniform symbols are bound once per batch, and the subtrees over them only are evaluated once per block
+  constexpr auto model = x * (y * z + pi) - y / (z + 1.0) + x;
+  std::vector<double> hoisted(values.size()), hoisted_executed(values.size()), hoisted_affine(values.size());
+  symbolic_math::evaluate_columns_hoisted(model, { y = 0.5, z = 2.0 }, { x = xs }, hoisted, 64);
+  symbolic_math::Execution_Plan hoisted_plan = symbolic_math::execute(model, { y = 0.5, z = 2.0 }, { x = xs }, hoisted_executed, thresholds);
+  symbolic_math::execute(f, { y = 0.5, z = 2.0 }, { x = xs }, hoisted_affine, thresholds);
+  for (std::size_t i = 0; i < values.size(); ++i)
+  {
+    if (hoisted[i] != model.evaluate({ x = xs[i], y = 0.5, z = 2.0 }) || hoisted_executed[i] != hoisted[i] ||
+        hoisted_affine[i] != f.evaluate({ x = xs[i], y = 0.5, z = 2.0 }))
+    {
+      std::cerr << "hoisted evaluation does not match expected result\n";
+      return 1;
+    }
+  }
+  if (hoisted_plan.backend != symbolic_math::Backend::threaded || !hoisted_plan.blocked)
+  {
+    std::cerr << "hoisted execution plan does not match expected backend\n";
+    return 1;
+  }
+
+  // the tensor product of per-symbol axes, each subtree evaluated at the outermost loop level it depends on
+  constexpr auto swept = (x * x + pi) * y - z / (x + y) + x * 3.0;
+  std::vector<double> grid = symbolic_math::evaluate_grid(swept, { x = std::span(xs).first(5), y = std::span(ys).first(7), z = std::span(zs).first(9) }, 4);
+  for (std::size_t i = 0; i < 5 * 7 * 9; ++i)
+  {
+    if (grid.size() != 5 * 7 * 9 || grid[i] != swept.evaluate({ x = xs[i / 63], y = ys[i / 9 % 7], z = zs[i % 9] }))
+    {
+      std::cerr << "grid evaluation does not match expected result\n";
+      return 1;
+    }
+  }
+  // an axis the expression does not depend on only repeats rows
+  constexpr auto unswept = x * 3.0 + z;
+  std::vector<double> repeated = symbolic_math::evaluate_grid(unswept, { x = std::span(xs).first(5), y = std::span(ys).first(7), z = std::span(zs).first(9) }, 4);
+  for (std::size_t i = 0; i < 5 * 7 * 9; ++i)
+  {
+    if (repeated[i] != unswept.evaluate({ x = xs[i / 63], z = zs[i % 9] }))
+    {
+      std::cerr << "grid evaluation over an unused axis does not match expected result\n";
+      return 1;
+    }
+  }
+
+  // reductions fused into the batch kernel give the same results on any number of threads
+  symbolic_math::Reduction_Options reduction;
+  reduction.block_size = 16;
+  reduction.chunk_size = 64;
+  auto [reduced_sum, reduced_mean, reduced_min, reduced_max, histogram] =
+      symbolic_math::reduce_columns(f, { x = xs, y = ys, z = zs }, values.size(), reduction, symbolic_math::Sum_Sink{}, symbolic_math::Mean_Sink{},
+                                    symbolic_math::Min_Sink{}, symbolic_math::Max_Sink{}, symbolic_math::Histogram_Sink(0.0, 100.0, 10));
+  reduction.threads = 3;
+  auto [threaded_sum] = symbolic_math::reduce_columns(f, { x = xs, y = ys, z = zs }, values.size(), reduction, symbolic_math::Sum_Sink{});
+  reduction.thresholds.simd_min_operations = 0;
+  auto [blocked_sum] = symbolic_math::reduce_columns(f, { x = xs, y = ys, z = zs }, values.size(), reduction, symbolic_math::Sum_Sink{});
+  std::vector<double> reduced_values(values.size());
+  symbolic_math::evaluate_columns_scalar(f, { x = xs, y = ys, z = zs }, reduced_values);
+  double naive_sum = 0.0;
+  symbolic_math::Histogram binned{std::vector<std::size_t>(10), 0, 0, 0};
+  for (double value : reduced_values)
+  {
+    naive_sum += value;
+    value < 0.0 ? ++binned.underflow : value >= 100.0 ? ++binned.overflow : ++binned.counts[static_cast<std::size_t>(value * 0.1)];
+  }
+  if (threaded_sum != reduced_sum || blocked_sum != reduced_sum || std::abs(reduced_sum - naive_sum) > 1e-9 * std::abs(naive_sum) ||
+      reduced_mean != reduced_sum / static_cast<double>(values.size()) || reduced_min != *std::min_element(reduced_values.begin(), reduced_values.end()) ||
+      reduced_max != *std::max_element(reduced_values.begin(), reduced_values.end()) || histogram.counts != binned.counts || histogram.underflow != binned.underflow ||
+      histogram.overflow != binned.overflow || histogram.nan != 0)
+  {
+    std::cerr << "fused reductions do not match expected results\n";
+    return 1;
+  }
+
+  // a predicate selects rows as a mask, and the values of another expression there are compacted in the same pass
+  constexpr auto window = (x >= 10.0 && x < y * y) || y > 0.5;
+  static_assert(symbolic_math::Predicate<decltype(window)> && !symbolic_math::Symbolic<decltype(window)>, "predicates are not symbolic");
+  static_assert(window.evaluate({ x = 1.0, y = 0.75 }) && !window.evaluate({ x = 12.0, y = -3.0 }) && window.evaluate({ x = 12.0, y = -4.0 }),
+                "predicate result does not match expected value");
+  std::vector<double> expected_filtered;
+  for (std::size_t i = 0; i < reduced_values.size(); ++i)
+  {
+    if (window.evaluate({ x = xs[i], y = ys[i] }))
+    {
+      expected_filtered.push_back(reduced_values[i]);
+    }
+  }
+  std::vector<double> filtered(values.size());
+  std::size_t selected = symbolic_math::filter_columns(window, f, { x = xs, y = ys, z = zs }, values.size(), filtered, 13);
+  filtered.resize(selected);
+  std::vector<double> too_small(expected_filtered.size() - 1);
+  bool overflow_thrown = false;
+  try
+  {
+    symbolic_math::filter_columns(window, f, { x = xs, y = ys, z = zs }, values.size(), too_small);
+  }
+  catch (const std::logic_error &)
+  {
+    overflow_thrown = true;
+  }
+  if (expected_filtered.size() < 10 || expected_filtered.size() == values.size() || filtered != expected_filtered ||
+      symbolic_math::filter_columns(window, f, { x = xs, y = ys, z = zs }, values.size()) != expected_filtered || !overflow_thrown ||
+      window.symbolic_evaluate({ x = "x", y = "y" }) != "(((x >= 10) && (x < (y * y))) || (y > 0.5))")
+  {
+    std::cerr << "filtered rows do not match expected results\n";
+    return 1;
+  }
+
+  // the autotuner measures on first use, persists the winner keyed by cpu, expression and batch size, and
+  // execute follows it
+  std::filesystem::path tuning_cache = std::filesystem::temp_directory_path() / "symbolic_math_test_tuning.tsv";
+  std::filesystem::remove(tuning_cache);
+  symbolic_math::Kernel_Tuning tuning = symbolic_math::autotune(deep, 4096, tuning_cache);
+  std::optional<symbolic_math::Kernel_Tuning> cached_tuning =
+      symbolic_math::read_tuning_cache(tuning_cache, symbolic_math::tuning_key<decltype(deep)>(4096));
+  std::filesystem::remove(tuning_cache);
+  if (!cached_tuning || *cached_tuning != tuning || symbolic_math::autotune(deep, 4096, tuning_cache) != tuning || tuning.threads == 0 ||
+      std::find(symbolic_math::autotune_block_sizes.begin(), symbolic_math::autotune_block_sizes.end(), tuning.block_size) ==
+          symbolic_math::autotune_block_sizes.end())
+  {
+    std::cerr << "autotuned parameters were not persisted\n";
+    return 1;
+  }
+  symbolic_math::Execution_Plan tuned_plan = symbolic_math::execute(deep, { x = xs, y = ys, z = zs }, deep_blocked, thresholds, tuning);
+  if (deep_blocked != deep_scalar || tuned_plan.block_size != tuning.block_size || tuned_plan.threads > tuning.threads)
+  {
+    std::cerr << "tuned execution does not match expected result\n";
+    return 1;
+  }
+
+  // exact rational constants fold without intermediate rounding
+  constexpr auto tenth = symbolic_math::Rational<1, 10>{} + symbolic_math::Rational<2, 10>{};
+  static_assert(std::is_same_v<std::remove_cv_t<decltype(tenth)>, symbolic_math::Rational<3, 10>> && tenth.value == 0.3,
+                "rational constants were not folded exactly");
+  static_assert(symbolic_math::Rational<9007199254740993>::value == 9007199254740992.0 && symbolic_math::Rational<1, 3>::value == 1.0 / 3.0,
+                "rational constants are not rounded to nearest");
+  constexpr auto scaled = symbolic_math::substitute(x * (y + symbolic_math::Rational<1, 10>{}) * (2.0 * pi), y, symbolic_math::Rational<1, 5>{});
+  constexpr auto folded = symbolic_math::fold_constants(scaled);
+  static_assert(std::is_same_v<std::remove_cv_t<decltype(folded.lhs.rhs)>, symbolic_math::Rational<3, 10>>, "rational subtree was not folded");
+  static_assert(folded.evaluate({ x = 1.0 }) == 0.3 * (2.0 * 3.14159265358979323846), "folded result does not match expected value");
+
+  // static operation counts, and the same counts tallied at run time by a counting scalar
+  constexpr symbolic_math::Operation_Counts counts = symbolic_math::count_operations(f);
+  static_assert(counts.loads == 3 && counts.constants == 2 && counts.adds == 1 && counts.subtracts == 1 && counts.multiplies == 1 &&
+                    counts.divides == 1 && counts.depth == 3 && counts.critical_path == 4.0 + 13.0 + 4.0,
+                "operation counts are wrong");
+  static_assert(symbolic_math::count_operations(chain).depth == 3 && symbolic_math::count_operations(balanced).depth == 2,
+                "n-ary depth is wrong");
+  symbolic_math::Counting_Scalar::reset();
+  symbolic_math::Counting_Scalar counted = symbolic_math::evaluate_as<symbolic_math::Counting_Scalar>(f, { x = 4.0, y = 2.0, z = 1.0 });
+  symbolic_math::Operation_Counts tallied = symbolic_math::Counting_Scalar::counts();
+  tallied.depth = counts.depth;
+  tallied.critical_path = counts.critical_path;
+  if (counted.value != result || tallied != counts)
+  {
+    std::cerr << "counted evaluation does not match static counts\n";
+    return 1;
+  }
+
+  // sampled per-node profile of graph evaluation, rendered as a tree and as folded stacks
+  symbolic_math::Graph_Profile profile;
+  profile.sample_period = 2;
+  for (int i = 0; i < 4; ++i)
+  {
+    if (symbolic_math::evaluate_profiled(graph, { x = 4.0, y = 2.0, z = 1.0 }, profile) != graph.evaluate({ x = 4.0, y = 2.0, z = 1.0 }))
+    {
+      std::cerr << "profiled evaluation does not match expected result\n";
+      return 1;
+    }
+  }
+  std::string stacks = symbolic_math::folded_stacks(graph, profile, { x = "x", y = "y", z = "z" });
+  std::string annotated = symbolic_math::annotated_symbolic_evaluate(graph, profile, { x = "x", y = "y", z = "z" });
+  if (profile.evaluations != 4 || profile.samples != 2 || profile.nodes.size() != graph.nodes.size() || profile.nodes[graph.root].calls != 2 ||
+      !stacks.starts_with("-[" + std::to_string(graph.root) + "] ") ||
+      static_cast<std::size_t>(std::count(stacks.begin(), stacks.end(), '\n')) != graph.nodes.size() ||
+      annotated.find("shared, node") == std::string::npos)
+  {
+    std::cerr << "profile does not match expected result\n";
+    return 1;
+  }
+
+  // tiered evaluation interprets until the threshold, then swaps in the graph compiled in the background
+  symbolic_math::Tiering_Options tiering;
+  tiering.threshold = 3;
+  symbolic_math::Tiered_Graph tiered(graph, tiering);
+  for (int i = 0; i < 2; ++i)
+  {
+    if (tiered.evaluate({ x = 4.0, y = 2.0, z = 1.0 }) != graph.evaluate({ x = 4.0, y = 2.0, z = 1.0 }) ||
+        tiered.tier() != symbolic_math::Tiered_Graph::Tier::interpreted)
+    {
+      std::cerr << "tiered evaluation compiled before the threshold\n";
+      return 1;
+    }
+  }
+  tiered.evaluate({ x = 4.0, y = 2.0, z = 1.0 });
+  if (tiered.wait() != symbolic_math::Tiered_Graph::Tier::compiled || tiered.evaluate({ x = 3.0, y = 5.0, z = 7.0 }) != graph.evaluate({ x = 3.0, y = 5.0, z = 7.0 }) ||
+      tiered.interpreted_evaluations() != 3)
+  {
+    std::cerr << "compiled tier does not match expected result\n";
+    return 1;
+  }
+  symbolic_math::Graph constants;
+  std::size_t sum = constants.operation(symbolic_math::Operation::add, constants.constant(2.0), constants.constant(3.0));
+  constants.root = constants.operation(symbolic_math::Operation::multiply, constants.symbol(x.tag), sum);
+  symbolic_math::Compiled_Graph lowered = symbolic_math::compile_graph(constants);
+  if (lowered.code.size() != 1 || lowered.evaluate({ x = 4.0 }) != 20.0)
+  {
+    std::cerr << "compiled graph did not fold constant operations\n";
+    return 1;
+  }
+
+  // value-profile-guided specialization folds in the symbols bound to one value while interpreted, behind a guard
+  tiering.threshold = 4;
+  tiering.specialize = true;
+  symbolic_math::Tiered_Graph specializing(graph, tiering);
+  for (int i = 0; i < 4; ++i)
+  {
+    specializing.evaluate({ x = 1.0 + i, y = 2.0, z = 3.0 * i });
+  }
+  symbolic_math::Tiered_Graph::Tier specialized_tier = specializing.wait();
+  std::vector<symbolic_math::Binding> specialized_symbols = specializing.specialized_symbols();
+  if (specialized_tier != symbolic_math::Tiered_Graph::Tier::compiled || specialized_symbols.size() != 1 || specialized_symbols[0].tag != y.tag || specialized_symbols[0].value != 2.0 ||
+      specializing.evaluate({ x = 5.0, y = 2.0, z = 7.0 }) != graph.evaluate({ x = 5.0, y = 2.0, z = 7.0 }) || specializing.guard_failures() != 0 ||
+      specializing.evaluate({ x = 5.0, y = -3.0, z = 7.0 }) != graph.evaluate({ x = 5.0, y = -3.0, z = 7.0 }) || specializing.guard_failures() != 1)
+  {
+    std::cerr << "specialized graph does not match expected result\n";
+    return 1;
+  }
+
+  // pipeline trace events, recorded only when built with SYMBOLIC_MATH_TRACE
+  std::ostringstream trace;
+  symbolic_math::write_chrome_trace(trace);
+#if defined(SYMBOLIC_MATH_TRACE)
+  bool traced = trace.str().find("\"name\": \"saturate\"") != std::string::npos && trace.str().find("\"cat\": \"evaluate\"") != std::string::npos;
+  // threads return their trace buffers when they end, so threads started per call add no buffers
+  std::size_t buffers_before = symbolic_math::trace_buffer_count();
+  for (std::size_t i = 0; i < 64; ++i)
+  {
+    std::jthread([&] { symbolic_math::execute(deep, { x = xs, y = ys, z = zs }, deep_blocked, thresholds); }).join();
+  }
+  traced = traced && symbolic_math::trace_buffer_count() <= buffers_before + 1;
+#else
+  bool traced = trace.str() == "{\"traceEvents\": []}\n";
+#endif
+  if (!traced)
+  {
+    std::cerr << "trace does not match expected events\n";
+    return 1;
+  }
+
   std::string result_text = f.symbolic_evaluate({ x = "x", y = "y", z = "z", pi = "pi" });
   std::cout << result_text << "\n";
+  std::cout << g.symbolic_evaluate({ y = "y", z = "z", pi = "pi" }) << "\n";
 
   return 0;
 }
\ No newline at end of file
@@ -8,16 +8,53 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
 #include <initializer_list>
+#include <limits>
+#include <numeric>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <format>
+#include <type_traits>
+#include <utility>
 
 namespace symbolic_math
 {
 
   using Tag = const void *;
 
+  enum class Operation
+  {
+    constant,
+    symbol,
+    add,
+    subtract,
+    multiply,
+    divide
+  };
+
+  template <typename E>
+  struct Expression;
+
+  // the operators below only apply to expression nodes and Expression
+  template <typename T>
+  struct is_symbolic : std::bool_constant<requires { typename std::integral_constant<Operation, T::operation>; }>
+  {
+  };
+
+  template <typename E>
+  struct is_symbolic<Expression<E>> : std::true_type
+  {
+  };
+
+  template <typename T>
+  concept Symbolic = is_symbolic<T>::value;
+
   struct Binding
   {
     Tag tag;
@@ -30,6 +67,13 @@ namespace symbolic_math
     std::string name;
   };
 
+  // a column of values for one symbol, used by batch evaluation
+  struct ColumnBinding
+  {
+    Tag tag;
+    std::span<const double> values;
+  };
+
   constexpr double get_binding_value(Tag tag, std::initializer_list<Binding> symbolic_bindings)
   {
     for (const auto &b : symbolic_bindings)
@@ -54,6 +98,18 @@ namespace symbolic_math
     return "";
   }
 
+  constexpr std::span<const double> get_column_binding_values(Tag tag, std::initializer_list<ColumnBinding> column_bindings)
+  {
+    for (const auto &b : column_bindings)
+    {
+      if (b.tag == tag)
+      {
+        return b.values;
+      }
+    }
+    throw std::logic_error("symbolic_math: get_column_binding_values: error: undefined symbol in expression");
+  }
+
   template <typename>
   struct Symbol_Id
   {
@@ -61,10 +117,37 @@ namespace symbolic_math
     static constexpr Tag tag = std::addressof(singleton);
   };
 
+  // symbols with an ordinal have a stable order, used by canonicalize and structural_hash
+
+  inline constexpr std::size_t unordered_symbol = std::numeric_limits<std::size_t>::max();
+
+  template <std::size_t N>
+  struct Symbol_Ordinal
+  {
+    static constexpr auto singleton = [] {};
+    static constexpr Tag tag = std::addressof(singleton);
+    static constexpr std::size_t ordinal = N;
+  };
+
+  template <typename Id>
+  constexpr std::size_t symbol_ordinal()
+  {
+    if constexpr (requires { Id::ordinal; })
+    {
+      return Id::ordinal;
+    }
+    else
+    {
+      return unordered_symbol;
+    }
+  }
+
   template <typename Id = Symbol_Id<decltype([] {})>>
   struct Symbol
   {
+    static constexpr Operation operation = Operation::symbol;
     static constexpr const auto tag = Id::tag;
+    static constexpr std::size_t ordinal = symbol_ordinal<Id>();
 
     constexpr Symbol() = default;
     constexpr Symbol(const Symbol &) = default;
@@ -79,6 +162,10 @@ namespace symbolic_math
     {
       return SymbolicBinding{tag, n};
     }
+    constexpr ColumnBinding operator=(std::span<const double> values) const noexcept
+    {
+      return ColumnBinding{tag, values};
+    }
     constexpr double evaluate(std::initializer_list<Binding> bindings) const
     {
       return get_binding_value(tag, bindings);
@@ -89,9 +176,13 @@ namespace symbolic_math
     }
   };
 
+  template <std::size_t N>
+  using Ordered_Symbol = Symbol<Symbol_Ordinal<N>>;
+
   template <typename Id = Symbol_Id<decltype([] {})>>
   struct Constant
   {
+    static constexpr Operation operation = Operation::constant;
     static constexpr const auto tag = Id::tag;
     double value;
     constexpr Constant(double v) : value(v) {}
@@ -115,9 +206,192 @@ namespace symbolic_math
     }
   };
 
+  // exact rational constants, e.g. Rational<1, 3>; arithmetic between them is done exactly at compile time,
+  // and the result is rounded to double once
+
+  struct Exact_Ratio
+  {
+    std::intmax_t num;
+    std::intmax_t den;
+  };
+
+  constexpr std::intmax_t checked_add(std::intmax_t a, std::intmax_t b)
+  {
+    if ((b > 0 && a > std::numeric_limits<std::intmax_t>::max() - b) || (b < 0 && a < std::numeric_limits<std::intmax_t>::min() - b))
+    {
+      throw std::logic_error("symbolic_math: Rational: error: overflow");
+    }
+    return a + b;
+  }
+
+  constexpr std::intmax_t checked_multiply(std::intmax_t a, std::intmax_t b)
+  {
+    constexpr std::intmax_t max = std::numeric_limits<std::intmax_t>::max();
+    if (a != 0 && b != 0 && (a < -max || b < -max || (a < 0 ? -a : a) > max / (b < 0 ? -b : b)))
+    {
+      throw std::logic_error("symbolic_math: Rational: error: overflow");
+    }
+    return a * b;
+  }
+
+  constexpr Exact_Ratio make_ratio(std::intmax_t num, std::intmax_t den)
+  {
+    if (den == 0)
+    {
+      throw std::logic_error("symbolic_math: Rational: error: zero denominator");
+    }
+    if (den < 0)
+    {
+      num = checked_multiply(num, -1);
+      den = checked_multiply(den, -1);
+    }
+    else if (num == std::numeric_limits<std::intmax_t>::min())
+    {
+      throw std::logic_error("symbolic_math: Rational: error: overflow");
+    }
+    std::intmax_t g = std::gcd(num, den);
+    return Exact_Ratio{num / g, den / g};
+  }
+
+  constexpr Exact_Ratio ratio_add(Exact_Ratio lhs, Exact_Ratio rhs)
+  {
+    std::intmax_t g = std::gcd(lhs.den, rhs.den);
+    return make_ratio(checked_add(checked_multiply(lhs.num, rhs.den / g), checked_multiply(rhs.num, lhs.den / g)),
+                      checked_multiply(lhs.den, rhs.den / g));
+  }
+
+  constexpr Exact_Ratio ratio_multiply(Exact_Ratio lhs, Exact_Ratio rhs)
+  {
+    std::intmax_t g1 = std::gcd(lhs.num, rhs.den);
+    std::intmax_t g2 = std::gcd(rhs.num, lhs.den);
+    return make_ratio(checked_multiply(lhs.num / g1, rhs.num / g2), checked_multiply(lhs.den / g2, rhs.den / g1));
+  }
+
+  constexpr Exact_Ratio ratio_apply(Operation operation, Exact_Ratio lhs, Exact_Ratio rhs)
+  {
+    switch (operation)
+    {
+    case Operation::add:
+      return ratio_add(lhs, rhs);
+    case Operation::subtract:
+      return ratio_add(lhs, Exact_Ratio{checked_multiply(rhs.num, -1), rhs.den});
+    case Operation::multiply:
+      return ratio_multiply(lhs, rhs);
+    case Operation::divide:
+      return ratio_multiply(lhs, make_ratio(rhs.den, rhs.num));
+    default:
+      throw std::logic_error("symbolic_math: ratio_apply: error: not a binary operation");
+    }
+  }
+
+  // num / den rounded to nearest, ties to even; the quotient is developed bit by bit, so only the final rounding is inexact
+  constexpr double ratio_to_double(Exact_Ratio ratio)
+  {
+    if (ratio.num == 0)
+    {
+      return 0.0;
+    }
+    std::uint64_t n = ratio.num < 0 ? 0 - static_cast<std::uint64_t>(ratio.num) : static_cast<std::uint64_t>(ratio.num);
+    std::uint64_t d = static_cast<std::uint64_t>(ratio.den);
+    std::uint64_t q = n / d;
+    std::uint64_t r = n % d;
+    int exponent = 0;
+    bool sticky = false;
+
+    // 54 quotient bits: 53 significant bits and the rounding bit
+    while (q >= std::uint64_t(1) << 54)
+    {
+      sticky = sticky || (q & 1) != 0;
+      q >>= 1;
+      ++exponent;
+    }
+    while (q < std::uint64_t(1) << 53)
+    {
+      r <<= 1;
+      q = (q << 1) | (r >= d ? 1 : 0);
+      r = r >= d ? r - d : r;
+      --exponent;
+    }
+    bool round = (q & 1) != 0;
+    q >>= 1;
+    ++exponent;
+    sticky = sticky || r != 0;
+    if (round && (sticky || (q & 1) != 0))
+    {
+      ++q;
+    }
+
+    double result = static_cast<double>(q);
+    for (; exponent > 0; --exponent)
+    {
+      result *= 2.0;
+    }
+    for (; exponent < 0; ++exponent)
+    {
+      result /= 2.0;
+    }
+    return ratio.num < 0 ? -result : result;
+  }
+
+  template <std::intmax_t Num, std::intmax_t Den = 1>
+  struct Rational
+  {
+    static constexpr Operation operation = Operation::constant;
+    static constexpr Tag tag = nullptr;
+    static constexpr Exact_Ratio ratio = make_ratio(Num, Den);
+    static constexpr double value = ratio_to_double(ratio);
+    constexpr double evaluate(std::initializer_list<Binding>) const { return value; }
+    constexpr std::string symbolic_evaluate(std::initializer_list<SymbolicBinding>) const
+    {
+      return ratio.den == 1 ? std::format("{}", ratio.num) : std::format("({}/{})", ratio.num, ratio.den);
+    }
+  };
+
+  template <typename T>
+  struct is_rational : std::false_type
+  {
+  };
+
+  template <std::intmax_t Num, std::intmax_t Den>
+  struct is_rational<Rational<Num, Den>> : std::true_type
+  {
+  };
+
+  template <Operation Op, typename LHS, typename RHS>
+  constexpr auto fold_rational()
+  {
+    constexpr Exact_Ratio ratio = ratio_apply(Op, LHS::ratio, RHS::ratio);
+    return Rational<ratio.num, ratio.den>{};
+  }
+
+  template <std::intmax_t N1, std::intmax_t D1, std::intmax_t N2, std::intmax_t D2>
+  constexpr auto operator+(const Rational<N1, D1> &, const Rational<N2, D2> &)
+  {
+    return fold_rational<Operation::add, Rational<N1, D1>, Rational<N2, D2>>();
+  }
+
+  template <std::intmax_t N1, std::intmax_t D1, std::intmax_t N2, std::intmax_t D2>
+  constexpr auto operator-(const Rational<N1, D1> &, const Rational<N2, D2> &)
+  {
+    return fold_rational<Operation::subtract, Rational<N1, D1>, Rational<N2, D2>>();
+  }
+
+  template <std::intmax_t N1, std::intmax_t D1, std::intmax_t N2, std::intmax_t D2>
+  constexpr auto operator*(const Rational<N1, D1> &, const Rational<N2, D2> &)
+  {
+    return fold_rational<Operation::multiply, Rational<N1, D1>, Rational<N2, D2>>();
+  }
+
+  template <std::intmax_t N1, std::intmax_t D1, std::intmax_t N2, std::intmax_t D2>
+  constexpr auto operator/(const Rational<N1, D1> &, const Rational<N2, D2> &)
+  {
+    return fold_rational<Operation::divide, Rational<N1, D1>, Rational<N2, D2>>();
+  }
+
   template <typename LHS, typename RHS>
   struct Add
   {
+    static constexpr Operation operation = Operation::add;
     LHS lhs;
     RHS rhs;
     constexpr double evaluate(std::initializer_list<Binding> bindings) const
@@ -130,7 +404,7 @@ namespace symbolic_math
     }
   };
 
-  template <typename LHS, typename RHS>
+  template <Symbolic LHS, Symbolic RHS>
   constexpr auto operator+(const LHS &lhs, const RHS &rhs)
   {
     return Add<LHS, RHS>{lhs, rhs};
@@ -139,6 +413,7 @@ namespace symbolic_math
   template <typename LHS, typename RHS>
   struct Subtract
   {
+    static constexpr Operation operation = Operation::subtract;
     LHS lhs;
     RHS rhs;
     constexpr double evaluate(std::initializer_list<Binding> bindings) const
@@ -151,7 +426,7 @@ namespace symbolic_math
     }
   };
 
-  template <typename LHS, typename RHS>
+  template <Symbolic LHS, Symbolic RHS>
   constexpr auto operator-(const LHS &lhs, const RHS &rhs)
   {
     return Subtract<LHS, RHS>{lhs, rhs};
@@ -160,6 +435,7 @@ namespace symbolic_math
   template <typename LHS, typename RHS>
   struct Multiply
   {
+    static constexpr Operation operation = Operation::multiply;
     LHS lhs;
     RHS rhs;
     constexpr double evaluate(std::initializer_list<Binding> bindings) const
@@ -172,7 +448,7 @@ namespace symbolic_math
     }
   };
 
-  template <typename LHS, typename RHS>
+  template <Symbolic LHS, Symbolic RHS>
   constexpr auto operator*(const LHS &lhs, const RHS &rhs)
   {
     return Multiply<LHS, RHS>{lhs, rhs};
@@ -181,6 +457,7 @@ namespace symbolic_math
   template <typename LHS, typename RHS>
   struct Divide
   {
+    static constexpr Operation operation = Operation::divide;
     LHS lhs;
     RHS rhs;
     constexpr double evaluate(std::initializer_list<Binding> bindings) const
@@ -193,40 +470,144 @@ namespace symbolic_math
     }
   };
 
-  template <typename LHS, typename RHS>
+  template <Symbolic LHS, Symbolic RHS>
   constexpr auto operator/(const LHS &lhs, const RHS &rhs)
   {
     return Divide<LHS, RHS>{lhs, rhs};
   }
 
+  // n-ary nodes, built by make_nary; they evaluate as a left fold, so make_nary<AddN>(a, b, c) rounds
+  // exactly like a + b + c, without nesting one Add type per operand
+
+  template <std::size_t I, typename T>
+  struct Operand
+  {
+    T value;
+  };
+
+  template <typename Indices, typename... Ts>
+  struct Operand_List;
+
+  template <std::size_t... I, typename... Ts>
+  struct Operand_List<std::index_sequence<I...>, Ts...> : Operand<I, Ts>...
+  {
+  };
+
+  template <typename... Ts>
+  using Operands = Operand_List<std::index_sequence_for<Ts...>, Ts...>;
+
+  template <std::size_t I, typename T>
+  constexpr const T &get_operand(const Operand<I, T> &operand)
+  {
+    return operand.value;
+  }
+
+  // calls f with the operands of an n-ary node; the operand types come from the list type,
+  // so no per-operand deduction against the bases is needed
+  template <std::size_t... I, typename... Ts, typename F>
+  constexpr decltype(auto) apply_operand_list(const Operand_List<std::index_sequence<I...>, Ts...> &operands, F &&f)
+  {
+    return f(static_cast<const Operand<I, Ts> &>(operands).value...);
+  }
+
+  template <typename N, typename F>
+  constexpr decltype(auto) apply_operands(const N &node, F &&f)
+  {
+    return apply_operand_list(node.operands, f);
+  }
+
+  template <typename... Ts>
+  struct AddN
+  {
+    static constexpr Operation operation = Operation::add;
+    static constexpr std::size_t arity = sizeof...(Ts);
+    Operands<Ts...> operands;
+    constexpr double evaluate(std::initializer_list<Binding> bindings) const
+    {
+      return apply_operands(*this, [&](const auto &...operand) { return (... + operand.evaluate(bindings)); });
+    }
+    constexpr std::string symbolic_evaluate(std::initializer_list<SymbolicBinding> symbolic_bindings) const
+    {
+      return apply_operands(*this, [&](const auto &first, const auto &...rest)
+                            { return "(" + (first.symbolic_evaluate(symbolic_bindings) + ... + (" + " + rest.symbolic_evaluate(symbolic_bindings))) + ")"; });
+    }
+  };
+
+  template <typename... Ts>
+  struct MultiplyN
+  {
+    static constexpr Operation operation = Operation::multiply;
+    static constexpr std::size_t arity = sizeof...(Ts);
+    Operands<Ts...> operands;
+    constexpr double evaluate(std::initializer_list<Binding> bindings) const
+    {
+      return apply_operands(*this, [&](const auto &...operand) { return (... * operand.evaluate(bindings)); });
+    }
+    constexpr std::string symbolic_evaluate(std::initializer_list<SymbolicBinding> symbolic_bindings) const
+    {
+      return apply_operands(*this, [&](const auto &first, const auto &...rest)
+                            { return "(" + (first.symbolic_evaluate(symbolic_bindings) + ... + (" * " + rest.symbolic_evaluate(symbolic_bindings))) + ")"; });
+    }
+  };
+
+  // builds an n-ary node in one step; chained + and * build nested binary nodes, since growing an n-ary
+  // node per operand would copy the operands seen so far and cost more to compile than the nesting
+  template <template <typename...> class Node, typename... Ts>
+  constexpr auto make_nary(const Ts &...operands)
+  {
+    return Node<Ts...>{Operands<Ts...>{{operands}...}};
+  }
+
+  template <std::size_t... I, typename... Ts, typename... Us>
+  constexpr auto append_operands(const Operand_List<std::index_sequence<I...>, Ts...> &operands, const Us &...operand)
+  {
+    return Operands<Ts..., Us...>{static_cast<const Operand<I, Ts> &>(operands)..., {operand}...};
+  }
+
+  // extends an n-ary node by any number of operands in one step; the result evaluates as the same
+  // left fold, so a long chain can be built from pieces
+  template <template <typename...> class Node, typename... Ts, typename... Us>
+  constexpr auto make_nary(const Node<Ts...> &node, const Us &...operands)
+  {
+    return Node<Ts..., Us...>{append_operands(node.operands, operands...)};
+  }
+
   constexpr auto make_constant(double d) { return Constant(d); }
 
-  template <typename T>
+  template <Symbolic T>
   constexpr auto operator*(double d, const T &expression)
   {
-    auto c = make_constant(d);
-    return Multiply<decltype(c), T>{c, expression};
+    return make_constant(d) * expression;
   }
 
-  template <typename T>
+  template <Symbolic T>
   constexpr auto operator*(const T &expr, double d)
   {
-    auto c = make_constant(d);
-    return Multiply<T, decltype(c)>{expr, c};
+    return expr * make_constant(d);
   }
 
-  template <typename T>
+  template <Symbolic T>
   constexpr auto operator+(double d, const T &expression)
   {
-    auto c = make_constant(d);
-    return Add<decltype(c), T>{c, expression};
+    return make_constant(d) + expression;
   }
 
-  template <typename T>
+  template <Symbolic T>
   constexpr auto operator+(const T &expression, double d)
   {
-    auto c = make_constant(d);
-    return Add<T, decltype(c)>{expression, c};
+    return expression + make_constant(d);
+  }
+
+  template <Symbolic T>
+  constexpr auto operator/(double d, const T &expression)
+  {
+    return make_constant(d) / expression;
+  }
+
+  template <Symbolic T>
+  constexpr auto operator/(const T &expression, double d)
+  {
+    return expression / make_constant(d);
   }
 
   template <typename E>
@@ -246,4 +627,485 @@ namespace symbolic_math
   template <typename E>
   Expression(const E &) -> Expression<E>;
 
+  // node traits
+
+  template <typename T>
+  struct is_expression : std::false_type
+  {
+  };
+
+  template <typename E>
+  struct is_expression<Expression<E>> : std::true_type
+  {
+  };
+
+  template <typename T>
+  concept Binary_Node = requires(const T &node) {
+    node.lhs;
+    node.rhs;
+  };
+
+  // same node template as T, with operands LHS and RHS
+  template <typename T, typename LHS, typename RHS>
+  struct rebind_node;
+
+  template <template <typename, typename> class Node, typename L, typename R, typename LHS, typename RHS>
+  struct rebind_node<Node<L, R>, LHS, RHS>
+  {
+    using type = Node<LHS, RHS>;
+  };
+
+  template <typename T, typename LHS, typename RHS>
+  using rebind_node_t = typename rebind_node<std::remove_cv_t<T>, LHS, RHS>::type;
+
+  template <Operation Op, typename LHS, typename RHS>
+  struct binary_node;
+
+  template <typename LHS, typename RHS>
+  struct binary_node<Operation::add, LHS, RHS>
+  {
+    using type = Add<LHS, RHS>;
+  };
+
+  template <typename LHS, typename RHS>
+  struct binary_node<Operation::subtract, LHS, RHS>
+  {
+    using type = Subtract<LHS, RHS>;
+  };
+
+  template <typename LHS, typename RHS>
+  struct binary_node<Operation::multiply, LHS, RHS>
+  {
+    using type = Multiply<LHS, RHS>;
+  };
+
+  template <typename LHS, typename RHS>
+  struct binary_node<Operation::divide, LHS, RHS>
+  {
+    using type = Divide<LHS, RHS>;
+  };
+
+  template <Operation Op, typename LHS, typename RHS>
+  using binary_node_t = typename binary_node<Op, LHS, RHS>::type;
+
+  template <typename T>
+  concept Nary_Node = requires(const T &node) { node.operands; };
+
+  template <std::size_t I, typename E>
+  using operand_t = std::remove_cvref_t<decltype(get_operand<I>(std::declval<const E &>().operands))>;
+
+  // same n-ary node template as T, with operands Us
+  template <typename T, typename... Us>
+  struct rebind_nary;
+
+  template <template <typename...> class Node, typename... Ts, typename... Us>
+  struct rebind_nary<Node<Ts...>, Us...>
+  {
+    using type = Node<Us...>;
+  };
+
+  template <typename T, typename... Us>
+  using rebind_nary_t = typename rebind_nary<std::remove_cv_t<T>, Us...>::type;
+
+  template <typename T, typename... Us>
+  constexpr auto rebuild_nary(const Us &...operands)
+  {
+    return rebind_nary_t<T, Us...>{Operands<Us...>{{operands}...}};
+  }
+
+  // an n-ary node is structurally the left-nested chain it evaluates as, e.g. AddN<a, b, c> is Add<Add<a, b>, c>
+
+  template <typename E, typename Indices = std::make_index_sequence<E::arity - 1>>
+  struct nary_prefix;
+
+  template <typename E, std::size_t... I>
+  struct nary_prefix<E, std::index_sequence<I...>>
+  {
+    using type = rebind_nary_t<E, operand_t<I, E>...>;
+  };
+
+  template <typename E>
+  struct nary_prefix<E, std::index_sequence<0>>
+  {
+    using type = operand_t<0, E>;
+  };
+
+  template <typename E>
+  struct nary_prefix<E, std::index_sequence<0, 1>>
+  {
+    using type = binary_node_t<E::operation, operand_t<0, E>, operand_t<1, E>>;
+  };
+
+  template <typename E>
+  using binary_view_t = binary_node_t<E::operation, typename nary_prefix<E>::type, operand_t<E::arity - 1, E>>;
+
+  // the value of that chain's root, with the prefix rebuilt from the first operands
+  template <typename E>
+  constexpr binary_view_t<E> binary_view(const E &expression)
+  {
+    return [&]<std::size_t... I>(std::index_sequence<I...>)
+    {
+      const auto &last = get_operand<E::arity - 1>(expression.operands);
+      if constexpr (E::arity == 2)
+      {
+        return binary_view_t<E>{get_operand<0>(expression.operands), last};
+      }
+      else if constexpr (E::arity == 3)
+      {
+        return binary_view_t<E>{typename nary_prefix<E>::type{get_operand<I>(expression.operands)...}, last};
+      }
+      else
+      {
+        return binary_view_t<E>{rebuild_nary<E>(get_operand<I>(expression.operands)...), last};
+      }
+    }(std::make_index_sequence<E::arity - 1>{});
+  }
+
+  template <typename E>
+  constexpr bool is_constant_free()
+  {
+    if constexpr (is_expression<E>::value)
+    {
+      return is_constant_free<decltype(E::e)>();
+    }
+    else if constexpr (Binary_Node<E>)
+    {
+      return is_constant_free<decltype(E::lhs)>() && is_constant_free<decltype(E::rhs)>();
+    }
+    else if constexpr (Nary_Node<E>)
+    {
+      return []<std::size_t... I>(std::index_sequence<I...>)
+      { return (is_constant_free<operand_t<I, E>>() && ...); }(std::make_index_sequence<E::arity>{});
+    }
+    else
+    {
+      return E::operation != Operation::constant;
+    }
+  }
+
+  template <typename E>
+  constexpr bool is_symbol_free()
+  {
+    if constexpr (is_expression<std::remove_cv_t<E>>::value)
+    {
+      return is_symbol_free<decltype(E::e)>();
+    }
+    else if constexpr (Binary_Node<E>)
+    {
+      return is_symbol_free<decltype(E::lhs)>() && is_symbol_free<decltype(E::rhs)>();
+    }
+    else if constexpr (Nary_Node<E>)
+    {
+      return []<std::size_t... I>(std::index_sequence<I...>)
+      { return (is_symbol_free<operand_t<I, E>>() && ...); }(std::make_index_sequence<E::arity>{});
+    }
+    else
+    {
+      return E::operation != Operation::symbol;
+    }
+  }
+
+  // substitute(outer, x, inner) replaces every leaf with the tag of x by inner
+
+  template <typename E, typename Id, typename R>
+  constexpr auto substitute(const E &expression, const Symbol<Id> &symbol, const R &replacement)
+  {
+    if constexpr (is_expression<E>::value)
+    {
+      return Expression(substitute(expression.e, symbol, replacement));
+    }
+    else if constexpr (is_expression<R>::value)
+    {
+      return substitute(expression, symbol, replacement.e);
+    }
+    else if constexpr (std::is_same_v<E, Symbol<Id>>)
+    {
+      return replacement;
+    }
+    else if constexpr (Binary_Node<E>)
+    {
+      auto lhs = substitute(expression.lhs, symbol, replacement);
+      auto rhs = substitute(expression.rhs, symbol, replacement);
+      return rebind_node_t<E, decltype(lhs), decltype(rhs)>{lhs, rhs};
+    }
+    else if constexpr (Nary_Node<E>)
+    {
+      return apply_operands(expression, [&](const auto &...operand)
+                            { return rebuild_nary<E>(substitute(operand, symbol, replacement)...); });
+    }
+    else
+    {
+      return expression;
+    }
+  }
+
+  // the distinct symbols of an expression, in order of first occurrence
+
+  template <typename E>
+  constexpr std::size_t symbol_occurrences()
+  {
+    if constexpr (is_expression<E>::value)
+    {
+      return symbol_occurrences<decltype(E::e)>();
+    }
+    else if constexpr (Binary_Node<E>)
+    {
+      return symbol_occurrences<decltype(E::lhs)>() + symbol_occurrences<decltype(E::rhs)>();
+    }
+    else if constexpr (Nary_Node<E>)
+    {
+      return []<std::size_t... I>(std::index_sequence<I...>)
+      { return (0 + ... + symbol_occurrences<operand_t<I, E>>()); }(std::make_index_sequence<E::arity>{});
+    }
+    else
+    {
+      return E::operation == Operation::symbol ? 1 : 0;
+    }
+  }
+
+  template <typename E, std::size_t N>
+  constexpr void collect_symbol_tags(std::array<Tag, N> &tags, std::size_t &count)
+  {
+    if constexpr (is_expression<E>::value)
+    {
+      collect_symbol_tags<decltype(E::e)>(tags, count);
+    }
+    else if constexpr (Binary_Node<E>)
+    {
+      collect_symbol_tags<decltype(E::lhs)>(tags, count);
+      collect_symbol_tags<decltype(E::rhs)>(tags, count);
+    }
+    else if constexpr (Nary_Node<E>)
+    {
+      [&]<std::size_t... I>(std::index_sequence<I...>)
+      { (collect_symbol_tags<operand_t<I, E>>(tags, count), ...); }(std::make_index_sequence<E::arity>{});
+    }
+    else if constexpr (E::operation == Operation::symbol)
+    {
+      if (std::find(tags.begin(), tags.begin() + count, E::tag) == tags.begin() + count)
+      {
+        tags[count++] = E::tag;
+      }
+    }
+  }
+
+  template <typename E>
+  constexpr auto symbol_tags()
+  {
+    constexpr auto collected = []
+    {
+      std::array<Tag, symbol_occurrences<E>()> tags{};
+      std::size_t count = 0;
+      collect_symbol_tags<E>(tags, count);
+      return std::pair(tags, count);
+    }();
+    std::array<Tag, collected.second> tags{};
+    std::copy_n(collected.first.begin(), collected.second, tags.begin());
+    return tags;
+  }
+
+  template <std::size_t N>
+  constexpr std::size_t symbol_index(const std::array<Tag, N> &tags, Tag tag)
+  {
+    return static_cast<std::size_t>(std::find(tags.begin(), tags.end(), tag) - tags.begin());
+  }
+
+  // canonical ordering of commutative operations
+  // operands are ordered by operation, then symbol ordinal, then operands; constants compare equal;
+  // symbols without an ordinal have no order that is the same in every translation unit, so only
+  // expressions of Ordered_Symbol are canonicalized
+  // only the first two operands of an n-ary node are ordered, since moving later ones would change rounding
+
+  constexpr bool is_commutative(Operation operation)
+  {
+    return operation == Operation::add || operation == Operation::multiply;
+  }
+
+  // in real arithmetic; floating point addition and multiplication are not associative
+  constexpr bool is_associative(Operation operation)
+  {
+    return operation == Operation::add || operation == Operation::multiply;
+  }
+
+  template <typename A, typename B>
+  constexpr int structural_compare()
+  {
+    if constexpr (is_expression<A>::value)
+    {
+      return structural_compare<decltype(A::e), B>();
+    }
+    else if constexpr (is_expression<B>::value)
+    {
+      return structural_compare<A, decltype(B::e)>();
+    }
+    else if constexpr (A::operation != B::operation)
+    {
+      return A::operation < B::operation ? -1 : 1;
+    }
+    else if constexpr (Nary_Node<A>)
+    {
+      return structural_compare<binary_view_t<A>, B>();
+    }
+    else if constexpr (Nary_Node<B>)
+    {
+      return structural_compare<A, binary_view_t<B>>();
+    }
+    else if constexpr (A::operation == Operation::symbol)
+    {
+      return A::ordinal == B::ordinal ? 0 : (A::ordinal < B::ordinal ? -1 : 1);
+    }
+    else if constexpr (Binary_Node<A>)
+    {
+      constexpr int c = structural_compare<decltype(A::lhs), decltype(B::lhs)>();
+      return c != 0 ? c : structural_compare<decltype(A::rhs), decltype(B::rhs)>();
+    }
+    else
+    {
+      return 0;
+    }
+  }
+
+  template <typename E>
+  constexpr auto canonicalize(const E &expression);
+
+  template <typename E, typename A, typename B, typename... Rest>
+  constexpr auto canonicalize_nary(const A &a, const B &b, const Rest &...rest)
+  {
+    if constexpr (is_commutative(E::operation) && structural_compare<B, A>() < 0)
+    {
+      return rebuild_nary<E>(b, a, rest...);
+    }
+    else
+    {
+      return rebuild_nary<E>(a, b, rest...);
+    }
+  }
+
+  template <typename E>
+  constexpr auto canonicalize(const E &expression)
+  {
+    if constexpr (is_expression<E>::value)
+    {
+      return Expression(canonicalize(expression.e));
+    }
+    else if constexpr (Binary_Node<E>)
+    {
+      auto lhs = canonicalize(expression.lhs);
+      auto rhs = canonicalize(expression.rhs);
+      if constexpr (is_commutative(E::operation) && structural_compare<decltype(rhs), decltype(lhs)>() < 0)
+      {
+        return rebind_node_t<E, decltype(rhs), decltype(lhs)>{rhs, lhs};
+      }
+      else
+      {
+        return rebind_node_t<E, decltype(lhs), decltype(rhs)>{lhs, rhs};
+      }
+    }
+    else if constexpr (Nary_Node<E>)
+    {
+      return apply_operands(expression, [](const auto &...operand) { return canonicalize_nary<E>(canonicalize(operand)...); });
+    }
+    else if constexpr (E::operation == Operation::symbol)
+    {
+      static_assert(E::ordinal != unordered_symbol, "symbolic_math: canonicalize: error: only expressions of Ordered_Symbol have a canonical order");
+      return expression;
+    }
+    else
+    {
+      return expression;
+    }
+  }
+
+  // structural hashing; canonicalize first to make the hash insensitive to operand order
+  // structural_hash_v<E> depends on the type only, structural_hash(e) also on constant values
+  // a symbol without an ordinal is hashed by its first occurrence among the symbols of the hashed
+  // expression, so x / y and x / x differ, while x - y and y - x, equal up to renaming, do not
+
+  inline constexpr std::uint64_t hash_seed = 0xcbf29ce484222325ull;
+
+  constexpr std::uint64_t hash_combine(std::uint64_t seed, std::uint64_t value)
+  {
+    return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+  }
+
+  // Root is the hashed expression, whose symbols number those without an ordinal
+  template <typename E, typename Root = E>
+  constexpr std::uint64_t structural_type_hash()
+  {
+    if constexpr (is_expression<E>::value)
+    {
+      return structural_type_hash<decltype(E::e), Root>();
+    }
+    else if constexpr (Nary_Node<E>)
+    {
+      return []<std::size_t... I>(std::index_sequence<I...>)
+      {
+        std::uint64_t h = structural_type_hash<operand_t<0, E>, Root>();
+        ((h = hash_combine(hash_combine(hash_combine(hash_seed, static_cast<std::uint64_t>(E::operation)), h), structural_type_hash<operand_t<I + 1, E>, Root>())), ...);
+        return h;
+      }(std::make_index_sequence<E::arity - 1>{});
+    }
+    else
+    {
+      std::uint64_t h = hash_combine(hash_seed, static_cast<std::uint64_t>(E::operation));
+      if constexpr (E::operation == Operation::symbol)
+      {
+        if constexpr (E::ordinal != unordered_symbol)
+        {
+          h = hash_combine(h, E::ordinal);
+        }
+        else
+        {
+          h = hash_combine(hash_combine(h, unordered_symbol), symbol_index(symbol_tags<Root>(), E::tag));
+        }
+      }
+      else if constexpr (Binary_Node<E>)
+      {
+        h = hash_combine(h, structural_type_hash<decltype(E::lhs), Root>());
+        h = hash_combine(h, structural_type_hash<decltype(E::rhs), Root>());
+      }
+      return h;
+    }
+  }
+
+  template <typename E>
+  inline constexpr std::uint64_t structural_hash_v = structural_type_hash<E>();
+
+  template <typename Root, typename E>
+  constexpr std::uint64_t structural_value_hash(const E &expression)
+  {
+    if constexpr (is_expression<E>::value)
+    {
+      return structural_value_hash<Root>(expression.e);
+    }
+    else if constexpr (E::operation == Operation::constant)
+    {
+      return hash_combine(structural_type_hash<E, Root>(), std::bit_cast<std::uint64_t>(expression.value));
+    }
+    else if constexpr (Binary_Node<E>)
+    {
+      std::uint64_t h = hash_combine(hash_seed, static_cast<std::uint64_t>(E::operation));
+      h = hash_combine(h, structural_value_hash<Root>(expression.lhs));
+      return hash_combine(h, structural_value_hash<Root>(expression.rhs));
+    }
+    else if constexpr (Nary_Node<E>)
+    {
+      return apply_operands(expression, [](const auto &first, const auto &...rest)
+                            {
+                              std::uint64_t h = structural_value_hash<Root>(first);
+                              ((h = hash_combine(hash_combine(hash_combine(hash_seed, static_cast<std::uint64_t>(E::operation)), h), structural_value_hash<Root>(rest))), ...);
+                              return h; });
+    }
+    else
+    {
+      return structural_type_hash<E, Root>();
+    }
+  }
+
+  template <typename E>
+  constexpr std::uint64_t structural_hash(const E &expression)
+  {
+    return structural_value_hash<E>(expression);
+  }
+
 }
\ No newline at end of file
@@ -0,0 +1,205 @@
+//
+// symbolic_math_affine.hpp
+// affine expressions as coefficient vectors, with blocked batch evaluation
+//
+// some ideas from https://www.youtube.com/watch?v=lPfA4SFojao
+// created using chatgpt and deepseek, improved by Farshid Mossaiby
+//
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "symbolic_math.hpp"
+#include "symbolic_math_trace.hpp"
+
+namespace symbolic_math
+{
+
+  // linearity analysis
+  // an expression is affine when it is c0 + Σ ci·xi for symbols xi and symbol-free ci, i.e. it only
+  // adds and subtracts affine terms, and multiplies or divides them by symbol-free subexpressions
+
+  template <typename E>
+  constexpr bool is_affine()
+  {
+    if constexpr (is_expression<std::remove_cv_t<E>>::value)
+    {
+      return is_affine<decltype(E::e)>();
+    }
+    else if constexpr (Binary_Node<E>)
+    {
+      using L = decltype(E::lhs);
+      using R = decltype(E::rhs);
+      switch (E::operation)
+      {
+      case Operation::add:
+      case Operation::subtract:
+        return is_affine<L>() && is_affine<R>();
+      case Operation::multiply:
+        return (is_symbol_free<L>() && is_affine<R>()) || (is_affine<L>() && is_symbol_free<R>());
+      default:
+        return is_affine<L>() && is_symbol_free<R>();
+      }
+    }
+    else if constexpr (Nary_Node<E>)
+    {
+      return []<std::size_t... I>(std::index_sequence<I...>)
+      {
+        if constexpr (E::operation == Operation::add)
+        {
+          return (is_affine<operand_t<I, E>>() && ...);
+        }
+        else
+        {
+          return (is_affine<operand_t<I, E>>() && ...) && (0 + ... + (is_symbol_free<operand_t<I, E>>() ? 0 : 1)) <= 1;
+        }
+      }(std::make_index_sequence<E::arity>{});
+    }
+    else
+    {
+      return true;
+    }
+  }
+
+  // c0 + Σ ci·xi; the batch kernel works on blocks of the result, so each block stays in cache while
+  // every input column adds its term, and the inner loops are plain strided-one loops the compiler vectorizes
+
+  inline constexpr std::size_t affine_block_size = 512;
+
+  template <std::size_t N>
+  struct Affine_Form
+  {
+    double offset = 0.0;
+    std::array<double, N> coefficients{};
+    std::array<Tag, N> tags{};
+
+    constexpr double evaluate(std::initializer_list<Binding> bindings) const
+    {
+      double result = offset;
+      for (std::size_t i = 0; i < N; ++i)
+      {
+        result += coefficients[i] * get_binding_value(tags[i], bindings);
+      }
+      return result;
+    }
+
+    // result[j] = offset + Σ coefficients[i] * column i [j], in the same order as evaluate
+    void evaluate(std::initializer_list<ColumnBinding> column_bindings, std::span<double> result) const
+    {
+      std::array<const double *, N> columns{};
+      for (std::size_t i = 0; i < N; ++i)
+      {
+        std::span<const double> values = get_column_binding_values(tags[i], column_bindings);
+        if (values.size() < result.size())
+        {
+          throw std::logic_error("symbolic_math: Affine_Form::evaluate: error: column is shorter than the result");
+        }
+        columns[i] = values.data();
+      }
+      evaluate(columns, result);
+    }
+
+    // the same with the columns already resolved, in the order of tags
+    void evaluate(const std::array<const double *, N> &columns, std::span<double> result) const
+    {
+      SYMBOLIC_MATH_TRACE_SCOPE("evaluate", "Affine_Form::evaluate");
+      double *out = result.data();
+      for (std::size_t begin = 0; begin < result.size(); begin += affine_block_size)
+      {
+        std::size_t end = std::min(result.size(), begin + affine_block_size);
+        for (std::size_t j = begin; j < end; ++j)
+        {
+          out[j] = offset;
+        }
+        for (std::size_t i = 0; i < N; ++i)
+        {
+          const double coefficient = coefficients[i];
+          const double *column = columns[i];
+          for (std::size_t j = begin; j < end; ++j)
+          {
+            out[j] += coefficient * column[j];
+          }
+        }
+      }
+    }
+  };
+
+  // lhs op rhs, where rhs_symbol_free tells which operand of * is the symbol-free factor; / always divides by rhs
+  template <std::size_t N>
+  constexpr Affine_Form<N> combine_affine(Operation operation, const Affine_Form<N> &lhs, const Affine_Form<N> &rhs, bool rhs_symbol_free)
+  {
+    if (operation == Operation::add || operation == Operation::subtract)
+    {
+      Affine_Form<N> result = lhs;
+      double sign = operation == Operation::add ? 1.0 : -1.0;
+      result.offset += sign * rhs.offset;
+      for (std::size_t i = 0; i < N; ++i)
+      {
+        result.coefficients[i] += sign * rhs.coefficients[i];
+      }
+      return result;
+    }
+
+    Affine_Form<N> result = rhs_symbol_free ? lhs : rhs;
+    double factor = rhs_symbol_free ? rhs.offset : lhs.offset;
+    auto scale = [&](double &d) { d = operation == Operation::divide ? d / factor : d * factor; };
+    scale(result.offset);
+    for (double &coefficient : result.coefficients)
+    {
+      scale(coefficient);
+    }
+    return result;
+  }
+
+  template <typename E, std::size_t N>
+  constexpr Affine_Form<N> to_affine(const E &expression, const std::array<Tag, N> &tags)
+  {
+    if constexpr (is_symbol_free<E>())
+    {
+      return Affine_Form<N>{expression.evaluate({}), {}, tags};
+    }
+    else if constexpr (Binary_Node<E>)
+    {
+      return combine_affine(E::operation, to_affine(expression.lhs, tags), to_affine(expression.rhs, tags), is_symbol_free<decltype(E::rhs)>());
+    }
+    else if constexpr (Nary_Node<E>)
+    {
+      return apply_operands(expression, [&](const auto &first, const auto &...rest)
+                            {
+                              Affine_Form<N> result = to_affine(first, tags);
+                              ((result = combine_affine(E::operation, result, to_affine(rest, tags), is_symbol_free<std::remove_cvref_t<decltype(rest)>>())), ...);
+                              return result; });
+    }
+    else
+    {
+      Affine_Form<N> result{0.0, {}, tags};
+      result.coefficients[symbol_index(tags, E::tag)] = 1.0;
+      return result;
+    }
+  }
+
+  // lowers an affine expression to coefficient-vector form; the coefficients are folded in a different order
+  // than the expression evaluates, so results may differ in rounding, as with Math_Policy::fast_math passes
+  template <typename E>
+  constexpr auto to_affine(const E &expression)
+  {
+    static_assert(is_affine<E>(), "symbolic_math: to_affine: error: expression is not affine");
+    if constexpr (is_expression<E>::value)
+    {
+      return to_affine(expression.e, symbol_tags<decltype(E::e)>());
+    }
+    else
+    {
+      return to_affine(expression, symbol_tags<E>());
+    }
+  }
+
+}
@@ -0,0 +1,267 @@
+//
+// symbolic_math_analysis.hpp
+// static and dynamic operation counts for symbolic_math.hpp expressions
+//
+// some ideas from https://www.youtube.com/watch?v=lPfA4SFojao
+// created using chatgpt and deepseek, improved by Farshid Mossaiby
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "symbolic_math.hpp"
+
+namespace symbolic_math
+{
+
+  // per-operation latencies in cycles, used for the critical path; loads and constants are free by default,
+  // so the critical path is that of the arithmetic
+  struct Latency_Model
+  {
+    double load = 0.0;
+    double constant = 0.0;
+    double add = 4.0;
+    double subtract = 4.0;
+    double multiply = 4.0;
+    double divide = 13.0;
+
+    constexpr double operator()(Operation operation) const
+    {
+      switch (operation)
+      {
+      case Operation::constant:
+        return constant;
+      case Operation::symbol:
+        return load;
+      case Operation::add:
+        return add;
+      case Operation::subtract:
+        return subtract;
+      case Operation::multiply:
+        return multiply;
+      case Operation::divide:
+        return divide;
+      }
+      return std::numeric_limits<double>::infinity();
+    }
+  };
+
+  struct Operation_Counts
+  {
+    std::size_t loads = 0; // symbol reads
+    std::size_t constants = 0;
+    std::size_t adds = 0;
+    std::size_t subtracts = 0;
+    std::size_t multiplies = 0;
+    std::size_t divides = 0;
+    std::size_t depth = 0;      // operations on the longest path from a leaf to the result
+    double critical_path = 0.0; // latency of the slowest path from a leaf to the result
+
+    constexpr std::size_t operations() const
+    {
+      return adds + subtracts + multiplies + divides;
+    }
+
+    constexpr void tally(Operation operation)
+    {
+      switch (operation)
+      {
+      case Operation::constant:
+        ++constants;
+        break;
+      case Operation::symbol:
+        ++loads;
+        break;
+      case Operation::add:
+        ++adds;
+        break;
+      case Operation::subtract:
+        ++subtracts;
+        break;
+      case Operation::multiply:
+        ++multiplies;
+        break;
+      case Operation::divide:
+        ++divides;
+        break;
+      }
+    }
+
+    constexpr bool operator==(const Operation_Counts &) const = default;
+  };
+
+  // counts of lhs op rhs, from the counts of its operands
+  constexpr Operation_Counts combine_counts(Operation operation, const Operation_Counts &lhs, const Operation_Counts &rhs,
+                                            const Latency_Model &latency)
+  {
+    Operation_Counts result{lhs.loads + rhs.loads, lhs.constants + rhs.constants, lhs.adds + rhs.adds, lhs.subtracts + rhs.subtracts,
+                            lhs.multiplies + rhs.multiplies, lhs.divides + rhs.divides};
+    result.tally(operation);
+    result.depth = std::max(lhs.depth, rhs.depth) + 1;
+    result.critical_path = std::max(lhs.critical_path, rhs.critical_path) + latency(operation);
+    return result;
+  }
+
+  // static counts from the type alone; every node of the tree is counted, since a tree shares no subexpressions
+  template <typename E>
+  constexpr Operation_Counts count_operations(const Latency_Model &latency = {})
+  {
+    using T = std::remove_cv_t<E>;
+    if constexpr (is_expression<T>::value)
+    {
+      return count_operations<decltype(T::e)>(latency);
+    }
+    else if constexpr (Binary_Node<T>)
+    {
+      return combine_counts(T::operation, count_operations<decltype(T::lhs)>(latency), count_operations<decltype(T::rhs)>(latency), latency);
+    }
+    else if constexpr (Nary_Node<T>)
+    {
+      return [&]<std::size_t... I>(std::index_sequence<I...>)
+      {
+        Operation_Counts result = count_operations<operand_t<0, T>>(latency);
+        ((result = combine_counts(T::operation, result, count_operations<operand_t<I + 1, T>>(latency), latency)), ...);
+        return result;
+      }(std::make_index_sequence<T::arity - 1>{});
+    }
+    else
+    {
+      Operation_Counts result;
+      result.tally(T::operation);
+      result.critical_path = latency(T::operation);
+      return result;
+    }
+  }
+
+  template <typename E>
+  constexpr Operation_Counts count_operations(const E &, const Latency_Model &latency = {})
+  {
+    return count_operations<E>(latency);
+  }
+
+  // evaluation with another scalar type T; leaves become T::load(value) and T::constant(value) when T has them,
+  // T(value) otherwise
+
+  template <typename T>
+  constexpr T apply_operation(Operation operation, const T &lhs, const T &rhs)
+  {
+    switch (operation)
+    {
+    case Operation::add:
+      return lhs + rhs;
+    case Operation::subtract:
+      return lhs - rhs;
+    case Operation::multiply:
+      return lhs * rhs;
+    case Operation::divide:
+      return lhs / rhs;
+    default:
+      throw std::logic_error("symbolic_math: apply_operation: error: not a binary operation");
+    }
+  }
+
+  template <typename T, typename E>
+  constexpr T evaluate_as(const E &expression, std::initializer_list<Binding> bindings)
+  {
+    if constexpr (is_expression<E>::value)
+    {
+      return evaluate_as<T>(expression.e, bindings);
+    }
+    else if constexpr (Binary_Node<E>)
+    {
+      return apply_operation<T>(E::operation, evaluate_as<T>(expression.lhs, bindings), evaluate_as<T>(expression.rhs, bindings));
+    }
+    else if constexpr (Nary_Node<E>)
+    {
+      return apply_operands(expression, [&](const auto &first, const auto &...rest)
+                            {
+                              T result = evaluate_as<T>(first, bindings);
+                              ((result = apply_operation<T>(E::operation, result, evaluate_as<T>(rest, bindings))), ...);
+                              return result; });
+    }
+    else if constexpr (E::operation == Operation::symbol)
+    {
+      if constexpr (requires { T::load(0.0); })
+      {
+        return T::load(expression.evaluate(bindings));
+      }
+      else
+      {
+        return T(expression.evaluate(bindings));
+      }
+    }
+    else
+    {
+      if constexpr (requires { T::constant(0.0); })
+      {
+        return T::constant(expression.evaluate(bindings));
+      }
+      else
+      {
+        return T(expression.evaluate(bindings));
+      }
+    }
+  }
+
+  // a double that tallies every load, constant and operation it takes part in, per thread;
+  // the dynamic counterpart of count_operations, for any code generic in its scalar type
+  struct Counting_Scalar
+  {
+    double value = 0.0;
+
+    static Operation_Counts &counts()
+    {
+      thread_local Operation_Counts tally;
+      return tally;
+    }
+
+    static void reset()
+    {
+      counts() = Operation_Counts{};
+    }
+
+    static Counting_Scalar load(double value)
+    {
+      counts().tally(Operation::symbol);
+      return Counting_Scalar{value};
+    }
+
+    static Counting_Scalar constant(double value)
+    {
+      counts().tally(Operation::constant);
+      return Counting_Scalar{value};
+    }
+
+    friend Counting_Scalar operator+(const Counting_Scalar &lhs, const Counting_Scalar &rhs)
+    {
+      counts().tally(Operation::add);
+      return Counting_Scalar{lhs.value + rhs.value};
+    }
+
+    friend Counting_Scalar operator-(const Counting_Scalar &lhs, const Counting_Scalar &rhs)
+    {
+      counts().tally(Operation::subtract);
+      return Counting_Scalar{lhs.value - rhs.value};
+    }
+
+    friend Counting_Scalar operator*(const Counting_Scalar &lhs, const Counting_Scalar &rhs)
+    {
+      counts().tally(Operation::multiply);
+      return Counting_Scalar{lhs.value * rhs.value};
+    }
+
+    friend Counting_Scalar operator/(const Counting_Scalar &lhs, const Counting_Scalar &rhs)
+    {
+      counts().tally(Operation::divide);
+      return Counting_Scalar{lhs.value / rhs.value};
+    }
+  };
+
+}
@@ -0,0 +1,235 @@
+//
+// symbolic_math_autotune.hpp
+// block size and thread count of the column kernels measured per expression on first use, and kept in a
+// local cache file keyed by cpu model, expression hash and batch size
+//
+// some ideas from https://www.youtube.com/watch?v=lPfA4SFojao
+// created using chatgpt and deepseek, improved by Farshid Mossaiby
+//
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "symbolic_math.hpp"
+#include "symbolic_math_affine.hpp"
+#include "symbolic_math_executor.hpp"
+
+namespace symbolic_math
+{
+
+  inline constexpr std::array<std::size_t, 6> autotune_block_sizes{64, 128, 256, 512, 1024, 2048};
+
+  // "model name" of /proc/cpuinfo and the number of hardware threads, since both decide the winner
+  inline std::string cpu_model()
+  {
+    std::string model = "unknown";
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    for (std::string line; std::getline(cpuinfo, line);)
+    {
+      if (line.starts_with("model name"))
+      {
+        std::size_t colon = line.find(':');
+        std::size_t begin = colon == std::string::npos ? std::string::npos : line.find_first_not_of(" \t", colon + 1);
+        if (begin != std::string::npos)
+        {
+          model = line.substr(begin);
+        }
+        break;
+      }
+    }
+    // the cache file separates fields by tabs
+    std::replace(model.begin(), model.end(), '\t', ' ');
+    return std::format("{} ({} threads)", model, std::max(1u, std::thread::hardware_concurrency()));
+  }
+
+  // SYMBOLIC_MATH_TUNING_CACHE if set, where an empty value turns persistence off, otherwise
+  // symbolic_math/tuning.tsv under XDG_CACHE_HOME or ~/.cache
+  inline std::filesystem::path default_tuning_cache_path()
+  {
+    if (const char *path = std::getenv("SYMBOLIC_MATH_TUNING_CACHE"))
+    {
+      return path;
+    }
+    if (const char *cache = std::getenv("XDG_CACHE_HOME"); cache != nullptr && *cache != '\0')
+    {
+      return std::filesystem::path(cache) / "symbolic_math" / "tuning.tsv";
+    }
+    if (const char *home = std::getenv("HOME"); home != nullptr && *home != '\0')
+    {
+      return std::filesystem::path(home) / ".cache" / "symbolic_math" / "tuning.tsv";
+    }
+    return {};
+  }
+
+  // cpu model, structural hash and batch size, tab separated, as they start a line of the cache file
+  template <typename E>
+  std::string tuning_key(std::size_t batch_size)
+  {
+    return std::format("{}\t{:016x}\t{}", cpu_model(), structural_hash_v<E>, batch_size);
+  }
+
+  // the last line of the cache file with the key, "key<TAB>block size<TAB>threads"; a missing or damaged
+  // file only means tuning again
+  inline std::optional<Kernel_Tuning> read_tuning_cache(const std::filesystem::path &path, std::string_view key)
+  {
+    std::optional<Kernel_Tuning> tuning;
+    if (path.empty())
+    {
+      return tuning;
+    }
+    std::ifstream in(path);
+    for (std::string line; std::getline(in, line);)
+    {
+      if (line.size() <= key.size() || !line.starts_with(key) || line[key.size()] != '\t')
+      {
+        continue;
+      }
+      std::istringstream fields(line.substr(key.size() + 1));
+      Kernel_Tuning read;
+      if (fields >> read.block_size >> read.threads && read.block_size != 0)
+      {
+        tuning = read;
+      }
+    }
+    return tuning;
+  }
+
+  // appends one line, so concurrent writers at worst tune the same expression twice
+  inline void write_tuning_cache(const std::filesystem::path &path, std::string_view key, const Kernel_Tuning &tuning)
+  {
+    if (path.empty())
+    {
+      return;
+    }
+    std::error_code error;
+    if (path.has_parent_path())
+    {
+      std::filesystem::create_directories(path.parent_path(), error);
+    }
+    bool exists = std::filesystem::exists(path, error);
+    std::ofstream out(path, std::ios::app);
+    if (!exists)
+    {
+      out << "# symbolic_math kernel tuning: cpu, expression hash, batch size, block size, threads\n";
+    }
+    out << key << '\t' << tuning.block_size << '\t' << tuning.threads << '\n';
+  }
+
+  // best of repetitions times of a body, in nanoseconds
+  template <typename F>
+  double time_best(std::size_t repetitions, const F &body)
+  {
+    double best = 0.0;
+    for (std::size_t i = 0; i < repetitions; ++i)
+    {
+      auto start = std::chrono::steady_clock::now();
+      body();
+      double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+      best = i == 0 ? elapsed : std::min(best, elapsed);
+    }
+    return best;
+  }
+
+  // measures the block sizes on synthetic columns of batch_size elements, then the thread counts up to
+  // max_threads with the best of them; the block size only matters to the blocked kernel, so when the
+  // element loop runs it stays the default
+  template <typename E>
+  Kernel_Tuning tune_kernel(const E &expression, std::size_t batch_size, const Executor_Thresholds &thresholds = {})
+  {
+    using Kernel = Column_Kernel<E>;
+    constexpr std::size_t repetitions = 5;
+    std::vector<std::vector<double>> values(Kernel::tags.size(), std::vector<double>(batch_size));
+    typename Kernel::Columns columns{};
+    for (std::size_t i = 0; i < values.size(); ++i)
+    {
+      // in [1, 2), away from the poles of divisions
+      for (std::size_t j = 0; j < batch_size; ++j)
+      {
+        values[i][j] = 1.0 + static_cast<double>((j + 3 * i) % 17) / 17.0;
+      }
+      columns[i] = values[i].data();
+    }
+    std::vector<double> result(batch_size);
+
+    Kernel_Tuning tuning;
+    const bool blocked = plan_execution<E>(batch_size, thresholds).blocked;
+    if (blocked)
+    {
+      double best = 0.0;
+      for (std::size_t block_size : autotune_block_sizes)
+      {
+        double elapsed = time_best(repetitions, [&]
+                                   { Kernel::simd(expression, columns, result, block_size); });
+        if (block_size == autotune_block_sizes.front() || elapsed < best)
+        {
+          best = elapsed;
+          tuning.block_size = block_size;
+        }
+      }
+    }
+
+    tuning.threads = 1;
+    const std::size_t max_threads = std::min(thresholds.max_threads, batch_size / tuning.block_size);
+    if (max_threads >= 2)
+    {
+      double best = time_best(repetitions, [&]
+                              { blocked ? Kernel::simd(expression, columns, result, tuning.block_size) : Kernel::scalar(expression, columns, result); });
+      for (std::size_t threads = 2; threads <= max_threads; threads = threads == max_threads ? threads + 1 : std::min(2 * threads, max_threads))
+      {
+        double elapsed = time_best(repetitions, [&]
+                                   { Kernel::threaded(expression, columns, result, threads, blocked, tuning.block_size); });
+        if (elapsed < best)
+        {
+          best = elapsed;
+          tuning.threads = threads;
+        }
+      }
+    }
+    return tuning;
+  }
+
+  // the tuning of E for batches of about batch_size, measured once per process and cpu, and read from the
+  // cache file when an earlier process measured it; call it at startup to keep the measuring out of the
+  // first evaluation, and pass the result to execute
+  template <typename E>
+  Kernel_Tuning autotune(const E &expression, std::size_t batch_size = 1 << 16, const std::filesystem::path &cache = default_tuning_cache_path())
+  {
+    static std::mutex mutex;
+    static std::unordered_map<std::string, Kernel_Tuning> tunings;
+
+    const std::string key = tuning_key<E>(batch_size);
+    std::lock_guard lock(mutex);
+    if (auto found = tunings.find(key); found != tunings.end())
+    {
+      return found->second;
+    }
+    std::optional<Kernel_Tuning> tuning = read_tuning_cache(cache, key);
+    if (!tuning)
+    {
+      tuning = tune_kernel(expression, batch_size);
+      write_tuning_cache(cache, key, *tuning);
+    }
+    tunings.emplace(key, *tuning);
+    return *tuning;
+  }
+
+}
@@ -0,0 +1,463 @@
+//
+// symbolic_math_egraph.hpp
+// equality saturation and cost-based extraction for runtime expression graphs
+//
+// some ideas from https://www.youtube.com/watch?v=lPfA4SFojao
+// created using chatgpt and deepseek, improved by Farshid Mossaiby
+//
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "symbolic_math.hpp"
+#include "symbolic_math_graph.hpp"
+#include "symbolic_math_trace.hpp"
+
+namespace symbolic_math
+{
+
+  // per-operation costs used to pick the cheapest equivalent expression
+  struct Cost_Model
+  {
+    double constant = 0.0;
+    double symbol = 0.0;
+    double add = 1.0;
+    double subtract = 1.0;
+    double multiply = 1.0;
+    double divide = 16.0;
+
+    constexpr double operator()(Operation operation) const
+    {
+      switch (operation)
+      {
+      case Operation::constant:
+        return constant;
+      case Operation::symbol:
+        return symbol;
+      case Operation::add:
+        return add;
+      case Operation::subtract:
+        return subtract;
+      case Operation::multiply:
+        return multiply;
+      case Operation::divide:
+        return divide;
+      }
+      return std::numeric_limits<double>::infinity();
+    }
+
+    // cost of evaluating a graph once, shared nodes counted once
+    double operator()(const Graph &graph) const
+    {
+      std::vector<bool> reachable(graph.nodes.size(), false);
+      reachable.at(graph.root) = true;
+      double total = 0.0;
+      for (std::size_t i = graph.root + 1; i-- > 0;)
+      {
+        const Node &node = graph.nodes[i];
+        if (!reachable[i])
+        {
+          continue;
+        }
+        total += (*this)(node.operation);
+        if (node.operation != Operation::constant && node.operation != Operation::symbol)
+        {
+          reachable[node.lhs] = reachable[node.rhs] = true;
+        }
+      }
+      return total;
+    }
+  };
+
+  struct Saturation_Limits
+  {
+    std::size_t node_limit = 10000;
+    std::size_t iteration_limit = 32;
+    std::chrono::milliseconds time_limit{100};
+  };
+
+  enum class Saturation
+  {
+    saturated,
+    node_limit,
+    iteration_limit,
+    time_limit
+  };
+
+  // an e-graph over Node, where lhs and rhs name e-classes instead of nodes
+  // the identities used are those of real arithmetic, so extracted expressions may round differently
+
+  class E_Graph
+  {
+  public:
+    std::size_t find(std::size_t c)
+    {
+      while (parent[c] != c)
+      {
+        c = parent[c] = parent[parent[c]];
+      }
+      return c;
+    }
+
+    std::size_t add(Node node)
+    {
+      node = canonical(node);
+      auto it = memo.find(node);
+      if (it != memo.end())
+      {
+        return find(it->second);
+      }
+      std::size_t c = parent.size();
+      parent.push_back(c);
+      classes.push_back({node});
+      memo.emplace(node, c);
+      return c;
+    }
+
+    std::size_t add(const Graph &graph)
+    {
+      std::vector<std::size_t> map(graph.nodes.size());
+      for (std::size_t i = 0; i < graph.nodes.size(); ++i)
+      {
+        Node node = graph.nodes[i];
+        if (is_operation(node))
+        {
+          node.lhs = map[node.lhs];
+          node.rhs = map[node.rhs];
+        }
+        map[i] = add(node);
+      }
+      return map.at(graph.root);
+    }
+
+    bool merge(std::size_t a, std::size_t b)
+    {
+      a = find(a);
+      b = find(b);
+      if (a == b)
+      {
+        return false;
+      }
+      if (classes[a].size() < classes[b].size())
+      {
+        std::swap(a, b);
+      }
+      parent[b] = a;
+      classes[a].insert(classes[a].end(), classes[b].begin(), classes[b].end());
+      classes[b].clear();
+      return true;
+    }
+
+    std::size_t node_count() const
+    {
+      return memo.size();
+    }
+
+    // the limits are checked before every rule adds nodes and before every match is merged, so the e-graph
+    // ends at most one rule's nodes past node_limit, and an iteration stops as soon as time_limit has passed
+    Saturation saturate(const Saturation_Limits &limits = {})
+    {
+      const auto deadline = std::chrono::steady_clock::now() + limits.time_limit;
+      auto exhausted = [&]
+      {
+        return node_count() >= limits.node_limit ? Saturation::node_limit
+               : std::chrono::steady_clock::now() >= deadline ? Saturation::time_limit
+                                                             : Saturation::saturated;
+      };
+      for (std::size_t iteration = 0; iteration < limits.iteration_limit; ++iteration)
+      {
+        std::vector<std::pair<std::size_t, Node>> matches;
+        for (std::size_t c = 0; c < classes.size(); ++c)
+        {
+          if (find(c) == c)
+          {
+            std::vector<Node> nodes = classes[c];
+            for (const Node &node : nodes)
+            {
+              if (!collect(c, node, matches, exhausted))
+              {
+                rebuild();
+                return exhausted();
+              }
+            }
+          }
+        }
+
+        bool changed = false;
+        for (const auto &[c, node] : matches)
+        {
+          if (Saturation reason = exhausted(); reason != Saturation::saturated)
+          {
+            rebuild();
+            return reason;
+          }
+          changed |= merge(c, add(node));
+        }
+        rebuild();
+
+        if (!changed)
+        {
+          return Saturation::saturated;
+        }
+        if (Saturation reason = exhausted(); reason != Saturation::saturated)
+        {
+          return reason;
+        }
+      }
+      return Saturation::iteration_limit;
+    }
+
+    Graph extract(std::size_t root, const Cost_Model &costs = {})
+    {
+      std::vector<double> best(classes.size(), std::numeric_limits<double>::infinity());
+      std::vector<Node> choice(classes.size());
+      for (bool changed = true; changed;)
+      {
+        changed = false;
+        for (std::size_t c = 0; c < classes.size(); ++c)
+        {
+          for (const Node &node : classes[c])
+          {
+            double cost = costs(node.operation);
+            if (is_operation(node))
+            {
+              cost += best[find(node.lhs)] + best[find(node.rhs)];
+            }
+            if (cost < best[c])
+            {
+              best[c] = cost;
+              choice[c] = node;
+              changed = true;
+            }
+          }
+        }
+      }
+
+      Graph graph;
+      std::vector<std::size_t> map(classes.size(), std::numeric_limits<std::size_t>::max());
+      graph.root = extract(find(root), choice, map, graph);
+      return graph;
+    }
+
+  private:
+    std::vector<std::size_t> parent;
+    std::vector<std::vector<Node>> classes;
+    std::unordered_map<Node, std::size_t, Node_Hash> memo;
+
+    static bool is_operation(const Node &node)
+    {
+      return node.operation != Operation::constant && node.operation != Operation::symbol;
+    }
+
+    Node canonical(Node node)
+    {
+      if (is_operation(node))
+      {
+        node.lhs = find(node.lhs);
+        node.rhs = find(node.rhs);
+      }
+      return node;
+    }
+
+    static Node make(Operation operation, std::size_t lhs, std::size_t rhs)
+    {
+      return Node{operation, 0.0, nullptr, lhs, rhs};
+    }
+
+    bool constant_of(std::size_t c, double &value) const
+    {
+      for (const Node &node : classes[c])
+      {
+        if (node.operation == Operation::constant)
+        {
+          value = node.value;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // restores congruence: nodes with equal canonical operands must share a class
+    void rebuild()
+    {
+      for (bool merged = true; merged;)
+      {
+        merged = false;
+        memo.clear();
+        for (std::size_t c = 0; c < classes.size(); ++c)
+        {
+          std::vector<Node> nodes = classes[c];
+          for (const Node &node : nodes)
+          {
+            std::size_t d = find(c);
+            auto [it, inserted] = memo.try_emplace(canonical(node), d);
+            if (!inserted && find(it->second) != d)
+            {
+              merge(it->second, d);
+              merged = true;
+            }
+          }
+        }
+      }
+      for (auto &nodes : classes)
+      {
+        std::vector<Node> unique;
+        for (const Node &node : nodes)
+        {
+          Node n = canonical(node);
+          if (std::find(unique.begin(), unique.end(), n) == unique.end())
+          {
+            unique.push_back(n);
+          }
+        }
+        nodes = std::move(unique);
+      }
+    }
+
+    // adds the right-hand sides of the identities matching node, paired with its class c; rules may add the
+    // inner nodes of their right-hand sides, so before each one exhausted is asked whether a limit is reached,
+    // and then false is returned
+    template <typename Exhausted>
+    bool collect(std::size_t c, const Node &node, std::vector<std::pair<std::size_t, Node>> &matches, const Exhausted &exhausted)
+    {
+      if (!is_operation(node))
+      {
+        return true;
+      }
+      auto stop = [&]
+      { return exhausted() != Saturation::saturated; };
+      Operation op = node.operation;
+      std::size_t a = find(node.lhs);
+      std::size_t b = find(node.rhs);
+
+      // constant folding
+      double va;
+      double vb;
+      if (constant_of(a, va) && constant_of(b, vb))
+      {
+        matches.emplace_back(c, Node{Operation::constant, Graph::evaluate_node(make(op, 0, 1), {va, vb}, {})});
+      }
+
+      // operands are copied, since add() may grow classes
+      const std::vector<Node> lhs_nodes = classes[a];
+      const std::vector<Node> rhs_nodes = classes[b];
+
+      // commutativity
+      if (is_commutative(op))
+      {
+        matches.emplace_back(c, make(op, b, a));
+      }
+
+      for (const Node &l : lhs_nodes)
+      {
+        // associativity: (x op y) op b = x op (y op b)
+        if (stop())
+        {
+          return false;
+        }
+        if (is_commutative(op) && l.operation == op)
+        {
+          std::size_t inner = add(make(op, l.rhs, b));
+          matches.emplace_back(c, make(op, l.lhs, inner));
+        }
+        // (x / y) / b = x / (y * b)
+        if (op == Operation::divide && l.operation == Operation::divide)
+        {
+          std::size_t inner = add(make(Operation::multiply, l.rhs, b));
+          matches.emplace_back(c, make(Operation::divide, l.lhs, inner));
+        }
+      }
+
+      for (const Node &r : rhs_nodes)
+      {
+        if (stop())
+        {
+          return false;
+        }
+        // distributivity: a * (x ± y) = a * x ± a * y
+        if (op == Operation::multiply && (r.operation == Operation::add || r.operation == Operation::subtract))
+        {
+          std::size_t x = add(make(Operation::multiply, a, r.lhs));
+          std::size_t y = add(make(Operation::multiply, a, r.rhs));
+          matches.emplace_back(c, make(r.operation, x, y));
+        }
+        // a * (x / y) = (a * x) / y
+        if (op == Operation::multiply && r.operation == Operation::divide)
+        {
+          std::size_t x = add(make(Operation::multiply, a, r.lhs));
+          matches.emplace_back(c, make(Operation::divide, x, r.rhs));
+        }
+      }
+
+      if (op == Operation::add || op == Operation::subtract)
+      {
+        for (const Node &l : lhs_nodes)
+        {
+          for (const Node &r : rhs_nodes)
+          {
+            if (l.operation != r.operation)
+            {
+              continue;
+            }
+            if (stop())
+            {
+              return false;
+            }
+            // factoring: x * y ± x * z = x * (y ± z)
+            if (l.operation == Operation::multiply && find(l.lhs) == find(r.lhs))
+            {
+              std::size_t sum = add(make(op, l.rhs, r.rhs));
+              matches.emplace_back(c, make(Operation::multiply, l.lhs, sum));
+            }
+            // x / z ± y / z = (x ± y) / z
+            if (l.operation == Operation::divide && find(l.rhs) == find(r.rhs))
+            {
+              std::size_t sum = add(make(op, l.lhs, r.lhs));
+              matches.emplace_back(c, make(Operation::divide, sum, l.rhs));
+            }
+          }
+        }
+      }
+      return true;
+    }
+
+    std::size_t extract(std::size_t c, const std::vector<Node> &choice, std::vector<std::size_t> &map, Graph &graph)
+    {
+      if (map[c] != std::numeric_limits<std::size_t>::max())
+      {
+        return map[c];
+      }
+      Node node = choice[c];
+      if (is_operation(node))
+      {
+        node.lhs = extract(find(node.lhs), choice, map, graph);
+        node.rhs = extract(find(node.rhs), choice, map, graph);
+      }
+      return map[c] = graph.add_node(node);
+    }
+  };
+
+  // equality saturation followed by extraction of the cheapest equivalent graph
+  inline Graph optimize(const Graph &graph, const Cost_Model &costs = {}, const Saturation_Limits &limits = {})
+  {
+    SYMBOLIC_MATH_TRACE_SCOPE("optimize", "optimize");
+    E_Graph egraph;
+    std::size_t root = egraph.add(graph);
+    {
+      SYMBOLIC_MATH_TRACE_SCOPE("optimize", "saturate");
+      egraph.saturate(limits);
+    }
+    SYMBOLIC_MATH_TRACE_SCOPE("optimize", "extract");
+    return egraph.extract(root, costs);
+  }
+
+}
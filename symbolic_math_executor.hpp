@@ -0,0 +1,660 @@
+//
+// symbolic_math_executor.hpp
+// column batch evaluation of any expression, and an executor choosing the scalar, simd or threaded kernel per call
+//
+// some ideas from https://www.youtube.com/watch?v=lPfA4SFojao
+// created using chatgpt and deepseek, improved by Farshid Mossaiby
+//
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <format>
+#include <initializer_list>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "symbolic_math.hpp"
+#include "symbolic_math_affine.hpp"
+#include "symbolic_math_analysis.hpp"
+#include "symbolic_math_optimize.hpp"
+#include "symbolic_math_trace.hpp"
+
+// the element loop is only fast when the whole expression is inlined into it, which the compiler's inlining
+// budget stops doing in large translation units
+#if defined(__GNUC__)
+#define SYMBOLIC_MATH_ALWAYS_INLINE [[gnu::always_inline]] inline
+#else
+#define SYMBOLIC_MATH_ALWAYS_INLINE inline
+#endif
+
+namespace symbolic_math
+{
+
+  // column kernels; the columns of an expression are resolved once per call, in the order of symbol_tags,
+  // and every symbol reads its column through an index known at compile time
+
+  inline constexpr std::size_t executor_block_size = 256;
+
+  template <typename Root>
+  struct Column_Kernel
+  {
+    static constexpr auto tags = symbol_tags<std::remove_cv_t<Root>>();
+    using Columns = std::array<const double *, tags.size()>;
+
+    // symbols bound to one value for the whole batch; a subtree over these only, or over no symbol at all,
+    // is evaluated once per block and broadcast, instead of once per element
+    struct Uniforms
+    {
+      std::array<bool, tags.size()> uniform{};
+      Columns values{}; // the value of each uniform symbol, as a column of one element
+    };
+
+    template <typename E>
+    static constexpr bool is_leaf = !is_expression<E>::value && !Binary_Node<E> && !Nary_Node<E>;
+
+    // scratch columns the blocked kernel needs at once: one for every right operand that is not a leaf,
+    // nested as deep as such operands are
+    template <typename E>
+    static constexpr std::size_t levels()
+    {
+      if constexpr (is_expression<E>::value)
+      {
+        return levels<decltype(E::e)>();
+      }
+      else if constexpr (Binary_Node<E>)
+      {
+        return std::max(levels<decltype(E::lhs)>(), operand_levels<decltype(E::rhs)>());
+      }
+      else if constexpr (Nary_Node<E>)
+      {
+        return []<std::size_t... I>(std::index_sequence<I...>)
+        { return std::max({levels<operand_t<0, E>>(), operand_levels<operand_t<I + 1, E>>()...}); }(std::make_index_sequence<E::arity - 1>{});
+      }
+      else
+      {
+        return 0;
+      }
+    }
+
+    template <typename E>
+    static constexpr std::size_t operand_levels()
+    {
+      if constexpr (is_leaf<E>)
+      {
+        return 0;
+      }
+      else
+      {
+        return 1 + levels<E>();
+      }
+    }
+
+    static Columns resolve(std::initializer_list<ColumnBinding> column_bindings, std::size_t size)
+    {
+      Columns columns{};
+      for (std::size_t i = 0; i < tags.size(); ++i)
+      {
+        std::span<const double> values = get_column_binding_values(tags[i], column_bindings);
+        if (values.size() < size)
+        {
+          throw std::logic_error("symbolic_math: evaluate_columns: error: column is shorter than the result");
+        }
+        columns[i] = values.data();
+      }
+      return columns;
+    }
+
+    // the uniform symbols, and columns for the others; a symbol bound both ways is uniform
+    static std::pair<Columns, Uniforms> resolve(std::initializer_list<Binding> uniform_bindings, std::initializer_list<ColumnBinding> column_bindings,
+                                                std::size_t size)
+    {
+      Columns columns{};
+      Uniforms uniforms;
+      for (std::size_t i = 0; i < tags.size(); ++i)
+      {
+        auto bound = std::find_if(uniform_bindings.begin(), uniform_bindings.end(), [i](const Binding &binding)
+                                  { return binding.tag == tags[i]; });
+        if (bound != uniform_bindings.end())
+        {
+          uniforms.uniform[i] = true;
+          uniforms.values[i] = &bound->value;
+          continue;
+        }
+        std::span<const double> values = get_column_binding_values(tags[i], column_bindings);
+        if (values.size() < size)
+        {
+          throw std::logic_error("symbolic_math: evaluate_columns: error: column is shorter than the result");
+        }
+        columns[i] = values.data();
+      }
+      return {columns, uniforms};
+    }
+
+    // uniform symbols have no column to offset
+    static Columns offset(Columns columns, std::size_t begin)
+    {
+      for (const double *&column : columns)
+      {
+        if (column != nullptr)
+        {
+          column += begin;
+        }
+      }
+      return columns;
+    }
+
+    template <typename E>
+    static bool all_uniform(const Uniforms &uniforms)
+    {
+      constexpr auto subtree = symbol_tags<E>();
+      for (Tag tag : subtree)
+      {
+        if (!uniforms.uniform[symbol_index(tags, tag)])
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    // one element, with the whole expression inlined into the loop around it
+    template <typename E>
+    SYMBOLIC_MATH_ALWAYS_INLINE static double element(const E &expression, const Columns &columns, std::size_t j)
+    {
+      if constexpr (is_expression<E>::value)
+      {
+        return element(expression.e, columns, j);
+      }
+      else if constexpr (Binary_Node<E>)
+      {
+        return apply_operation(E::operation, element(expression.lhs, columns, j), element(expression.rhs, columns, j));
+      }
+      else if constexpr (Nary_Node<E>)
+      {
+        return apply_operands(expression, [&](const auto &first, const auto &...rest)
+                              {
+                                double result = element(first, columns, j);
+                                ((result = apply_operation(E::operation, result, element(rest, columns, j))), ...);
+                                return result; });
+      }
+      else if constexpr (E::operation == Operation::symbol)
+      {
+        return columns[symbol_index(tags, E::tag)][j];
+      }
+      else
+      {
+        return expression.evaluate({});
+      }
+    }
+
+    static void scalar(const Root &expression, const Columns &columns, std::span<double> result)
+    {
+      for (std::size_t j = 0; j < result.size(); ++j)
+      {
+        result[j] = element(expression, columns, j);
+      }
+    }
+
+    // out[0, count) for the block at begin, one node at a time, so every loop is a plain strided-one loop;
+    // scratch has room for the remaining levels of count elements each
+    template <typename E>
+    static void block(const E &expression, const Columns &columns, std::size_t begin, std::size_t count, double *out, double *scratch,
+                      const Uniforms *uniforms = nullptr)
+    {
+      if constexpr (!is_leaf<E>)
+      {
+        if (uniforms != nullptr && all_uniform<E>(*uniforms))
+        {
+          std::fill_n(out, count, element(expression, uniforms->values, 0));
+          return;
+        }
+      }
+
+      if constexpr (is_expression<E>::value)
+      {
+        block(expression.e, columns, begin, count, out, scratch, uniforms);
+      }
+      else if constexpr (Binary_Node<E>)
+      {
+        block(expression.lhs, columns, begin, count, out, scratch, uniforms);
+        combine(E::operation, expression.rhs, columns, begin, count, out, scratch, uniforms);
+      }
+      else if constexpr (Nary_Node<E>)
+      {
+        apply_operands(expression, [&](const auto &first, const auto &...rest)
+                       {
+                         block(first, columns, begin, count, out, scratch, uniforms);
+                         (combine(E::operation, rest, columns, begin, count, out, scratch, uniforms), ...); });
+      }
+      else if constexpr (E::operation == Operation::symbol)
+      {
+        constexpr std::size_t i = symbol_index(tags, E::tag);
+        if (uniforms != nullptr && uniforms->uniform[i])
+        {
+          std::fill_n(out, count, *uniforms->values[i]);
+        }
+        else
+        {
+          std::copy_n(columns[i] + begin, count, out);
+        }
+      }
+      else
+      {
+        std::fill_n(out, count, expression.evaluate({}));
+      }
+    }
+
+    // out = out op operand; leaves are read in place, other operands are evaluated into the first scratch column
+    template <typename E>
+    static void combine(Operation operation, const E &operand, const Columns &columns, std::size_t begin, std::size_t count, double *out,
+                        double *scratch, const Uniforms *uniforms = nullptr)
+    {
+      if constexpr (!is_leaf<E>)
+      {
+        if (uniforms != nullptr && all_uniform<E>(*uniforms))
+        {
+          const double value = element(operand, uniforms->values, 0);
+          combine_into(operation, out, count, [value](std::size_t) { return value; });
+          return;
+        }
+      }
+
+      if constexpr (is_leaf<E> && E::operation == Operation::symbol)
+      {
+        constexpr std::size_t i = symbol_index(tags, E::tag);
+        if (uniforms != nullptr && uniforms->uniform[i])
+        {
+          const double value = *uniforms->values[i];
+          combine_into(operation, out, count, [value](std::size_t) { return value; });
+        }
+        else
+        {
+          const double *column = columns[i] + begin;
+          combine_into(operation, out, count, [column](std::size_t j) { return column[j]; });
+        }
+      }
+      else if constexpr (is_leaf<E>)
+      {
+        const double value = operand.evaluate({});
+        combine_into(operation, out, count, [value](std::size_t) { return value; });
+      }
+      else
+      {
+        block(operand, columns, begin, count, scratch, scratch + count, uniforms);
+        combine_into(operation, out, count, [scratch](std::size_t j) { return scratch[j]; });
+      }
+    }
+
+    template <typename F>
+    static void combine_into(Operation operation, double *out, std::size_t count, const F &rhs)
+    {
+      switch (operation)
+      {
+      case Operation::add:
+        for (std::size_t j = 0; j < count; ++j)
+        {
+          out[j] += rhs(j);
+        }
+        break;
+      case Operation::subtract:
+        for (std::size_t j = 0; j < count; ++j)
+        {
+          out[j] -= rhs(j);
+        }
+        break;
+      case Operation::multiply:
+        for (std::size_t j = 0; j < count; ++j)
+        {
+          out[j] *= rhs(j);
+        }
+        break;
+      default:
+        for (std::size_t j = 0; j < count; ++j)
+        {
+          out[j] /= rhs(j);
+        }
+        break;
+      }
+    }
+
+    // under Math_Policy::fast_math, affine expressions without uniform symbols use their coefficient form
+    // instead, which may differ in rounding as to_affine notes; otherwise every kernel gives the values of
+    // Expression::evaluate, bit for bit
+    template <Math_Policy Policy = Math_Policy::exact>
+    static void simd(const Root &expression, const Columns &columns, std::span<double> result, std::size_t block_size = executor_block_size,
+                     const Uniforms *uniforms = nullptr)
+    {
+      if constexpr (Policy == Math_Policy::fast_math && is_affine<Root>())
+      {
+        if (uniforms == nullptr)
+        {
+          to_affine(expression).evaluate(columns, result);
+          return;
+        }
+      }
+
+      block_size = std::max<std::size_t>(1, block_size);
+      std::vector<double> scratch(levels<Root>() * block_size);
+      for (std::size_t begin = 0; begin < result.size(); begin += block_size)
+      {
+        block(expression, columns, begin, std::min(block_size, result.size() - begin), result.data() + begin, scratch.data(), uniforms);
+      }
+    }
+
+    // the element loop or the blocked kernel on contiguous chunks of whole blocks, the first one on the calling thread
+    // the element loop reads every symbol from its column, so uniform symbols need the blocked kernel
+    template <Math_Policy Policy = Math_Policy::exact>
+    static void threaded(const Root &expression, const Columns &columns, std::span<double> result, std::size_t threads, bool blocked,
+                         std::size_t block_size = executor_block_size, const Uniforms *uniforms = nullptr)
+    {
+      block_size = std::max<std::size_t>(1, block_size);
+      threads = std::max<std::size_t>(1, std::min(threads, result.size() / block_size));
+      std::size_t blocks = (result.size() + block_size - 1) / block_size;
+      std::size_t chunk = (blocks + threads - 1) / threads * block_size;
+      auto run = [&](std::size_t begin)
+      {
+        std::size_t end = std::min(result.size(), begin + chunk);
+        if (blocked || uniforms != nullptr)
+        {
+          simd<Policy>(expression, offset(columns, begin), result.subspan(begin, end - begin), block_size, uniforms);
+        }
+        else
+        {
+          scalar(expression, offset(columns, begin), result.subspan(begin, end - begin));
+        }
+      };
+
+      std::vector<std::jthread> workers;
+      workers.reserve(threads - 1);
+      for (std::size_t begin = chunk; begin < result.size(); begin += chunk)
+      {
+        workers.emplace_back(run, begin);
+      }
+      run(0);
+    }
+  };
+
+  // result[j] = expression at element j of the columns, one element at a time
+  template <typename E>
+  void evaluate_columns_scalar(const E &expression, std::initializer_list<ColumnBinding> column_bindings, std::span<double> result)
+  {
+    Column_Kernel<E>::scalar(expression, Column_Kernel<E>::resolve(column_bindings, result.size()), result);
+  }
+
+  // the same in blocks, one node at a time, so each node is a vectorizable loop however large the expression
+  template <Math_Policy Policy = Math_Policy::exact, typename E>
+  void evaluate_columns_simd(const E &expression, std::initializer_list<ColumnBinding> column_bindings, std::span<double> result,
+                             std::size_t block_size = executor_block_size)
+  {
+    Column_Kernel<E>::template simd<Policy>(expression, Column_Kernel<E>::resolve(column_bindings, result.size()), result, block_size);
+  }
+
+  template <Math_Policy Policy = Math_Policy::exact, typename E>
+  void evaluate_columns_threaded(const E &expression, std::initializer_list<ColumnBinding> column_bindings, std::span<double> result,
+                                 std::size_t threads, bool blocked = true, std::size_t block_size = executor_block_size)
+  {
+    Column_Kernel<E>::template threaded<Policy>(expression, Column_Kernel<E>::resolve(column_bindings, result.size()), result, threads, blocked, block_size);
+  }
+
+  // the blocked kernel with the uniform symbols bound to one value each, e.g. the parameters of a model whose
+  // data vary per element; subtrees over parameters only cost once per block
+  template <typename E>
+  void evaluate_columns_hoisted(const E &expression, std::initializer_list<Binding> uniform_bindings,
+                                std::initializer_list<ColumnBinding> column_bindings, std::span<double> result,
+                                std::size_t block_size = executor_block_size)
+  {
+    auto [columns, uniforms] = Column_Kernel<E>::resolve(uniform_bindings, column_bindings, result.size());
+    Column_Kernel<E>::simd(expression, columns, result, block_size, &uniforms);
+  }
+
+  // executor
+
+  enum class Backend
+  {
+    scalar,
+    simd,
+    threaded
+  };
+
+  constexpr std::string_view backend_name(Backend backend)
+  {
+    switch (backend)
+    {
+    case Backend::scalar:
+      return "scalar";
+    case Backend::simd:
+      return "simd";
+    case Backend::threaded:
+      return "threaded";
+    }
+    return "unknown";
+  }
+
+  // the element loop wins on small expressions, which the compiler inlines and vectorizes whole, and on
+  // small batches; the blocked kernel wins once an expression is too large for that
+  struct Executor_Thresholds
+  {
+    std::size_t simd_min_operations = 16; // operations per element from which the blocked kernel beats the element loop
+    std::size_t simd_min_batch = 64;      // elements from which it does so, for an expression of that size
+    double threaded_min_work = 1 << 20;   // loads and operations per thread from which a thread pays for its start
+    std::size_t max_threads = 1;
+  };
+
+  // per-expression parameters, e.g. from autotune; threads caps the threads the thresholds allow, 0 leaves them
+  struct Kernel_Tuning
+  {
+    std::size_t block_size = executor_block_size;
+    std::size_t threads = 0;
+
+    bool operator==(const Kernel_Tuning &) const = default;
+  };
+
+  struct Execution_Plan
+  {
+    Backend backend = Backend::scalar;
+    bool blocked = false; // whether the kernel, or each thread's kernel, is the blocked one
+    std::size_t threads = 1;
+    std::size_t block_size = executor_block_size;
+    std::size_t batch_size = 0;
+    Operation_Counts counts;
+
+    std::string describe() const
+    {
+      return std::format("{} x{} ({}, block {}): {} elements, {} loads, {} operations, depth {}", backend_name(backend), threads,
+                         blocked ? "blocked" : "element loop", block_size, batch_size, counts.loads, counts.operations(), counts.depth);
+    }
+  };
+
+  // the static cost of E per element, and that times the batch size, against the thresholds; under
+  // Math_Policy::fast_math affine expressions take the blocked kernel, which evaluates their coefficient form
+  template <typename E, Math_Policy Policy = Math_Policy::exact>
+  Execution_Plan plan_execution(std::size_t batch_size, const Executor_Thresholds &thresholds, const Kernel_Tuning &tuning = {})
+  {
+    constexpr Operation_Counts counts = count_operations<E>();
+    constexpr bool coefficients = Policy == Math_Policy::fast_math && is_affine<E>();
+    Execution_Plan plan{Backend::scalar, false, 1, std::max<std::size_t>(1, tuning.block_size), batch_size, counts};
+    if (batch_size >= thresholds.simd_min_batch && (counts.operations() >= thresholds.simd_min_operations || coefficients))
+    {
+      plan.backend = Backend::simd;
+      plan.blocked = true;
+    }
+
+    double work = static_cast<double>(batch_size) * static_cast<double>(std::max<std::size_t>(1, counts.loads + counts.operations()));
+    std::size_t threads = std::min(thresholds.max_threads, static_cast<std::size_t>(work / std::max(1.0, thresholds.threaded_min_work)));
+    threads = std::min(threads, batch_size / plan.block_size);
+    if (tuning.threads != 0)
+    {
+      threads = std::min(threads, tuning.threads);
+    }
+    if (threads >= 2)
+    {
+      plan.backend = Backend::threaded;
+      plan.threads = threads;
+    }
+    return plan;
+  }
+
+  // a sum of Terms quotients over four columns, distinct per term so the compiler cannot share them
+  template <std::size_t Terms>
+  constexpr auto calibration_expression()
+  {
+    constexpr Ordered_Symbol<0> x;
+    constexpr Ordered_Symbol<1> y;
+    constexpr Ordered_Symbol<2> z;
+    constexpr Ordered_Symbol<3> w;
+    return [&]<std::size_t... I>(std::index_sequence<I...>)
+    { return make_nary<AddN>(((x * y - z) / (w + make_constant(1.0 + I)))...); }(std::make_index_sequence<Terms>{});
+  }
+
+  // best of repetitions times of one kernel, in nanoseconds
+  template <typename E>
+  double time_column_kernel(const E &expression, bool blocked, std::initializer_list<ColumnBinding> column_bindings, std::span<double> result,
+                            std::size_t repetitions = 16)
+  {
+    double best = 0.0;
+    for (std::size_t i = 0; i < repetitions; ++i)
+    {
+      auto start = std::chrono::steady_clock::now();
+      if (blocked)
+      {
+        evaluate_columns_simd(expression, column_bindings, result);
+      }
+      else
+      {
+        evaluate_columns_scalar(expression, column_bindings, result);
+      }
+      double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+      best = i == 0 ? elapsed : std::min(best, elapsed);
+    }
+    return best;
+  }
+
+  // measures, on sums of growing size, from how many operations and elements the blocked kernel beats the
+  // element loop, and the cost of starting a thread against the blocked kernel's cost per load or operation
+  inline Executor_Thresholds calibrate_executor()
+  {
+    constexpr Ordered_Symbol<0> x;
+    constexpr Ordered_Symbol<1> y;
+    constexpr Ordered_Symbol<2> z;
+    constexpr Ordered_Symbol<3> w;
+    constexpr std::size_t largest = 4096;
+    std::vector<double> xs(largest), ys(largest), zs(largest), ws(largest), result(largest);
+    for (std::size_t i = 0; i < largest; ++i)
+    {
+      xs[i] = 1.0 + static_cast<double>(i % 17);
+      ys[i] = 0.5 * static_cast<double>(i % 5);
+      zs[i] = 2.0 - 0.25 * static_cast<double>(i % 3);
+      ws[i] = 0.125 * static_cast<double>(i % 7);
+    }
+
+    // whether the blocked kernel is at least as fast as the element loop on the first n elements
+    auto blocked_wins = [&](const auto &expression, std::size_t n)
+    {
+      std::span<double> out(result.data(), n);
+      return time_column_kernel(expression, true, { x = xs, y = ys, z = zs, w = ws }, out) <=
+             time_column_kernel(expression, false, { x = xs, y = ys, z = zs, w = ws }, out);
+    };
+
+    Executor_Thresholds thresholds;
+    thresholds.max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    constexpr auto small = calibration_expression<1>();
+    constexpr auto medium = calibration_expression<4>();
+    constexpr auto large = calibration_expression<16>();
+    thresholds.simd_min_operations = blocked_wins(small, largest)    ? count_operations(small).operations()
+                                     : blocked_wins(medium, largest) ? count_operations(medium).operations()
+                                     : blocked_wins(large, largest)  ? count_operations(large).operations()
+                                                                     : 2 * count_operations(large).operations();
+
+    thresholds.simd_min_batch = 2 * largest;
+    for (std::size_t n = 4; n <= largest; n *= 2)
+    {
+      if (blocked_wins(large, n))
+      {
+        thresholds.simd_min_batch = n;
+        break;
+      }
+    }
+
+    constexpr Operation_Counts counts = count_operations<decltype(large)>();
+    double per_work = time_column_kernel(large, true, { x = xs, y = ys, z = zs, w = ws }, result) /
+                      static_cast<double>(largest * (counts.loads + counts.operations()));
+    double start = 0.0;
+    for (std::size_t i = 0; i < 8; ++i)
+    {
+      auto begin = std::chrono::steady_clock::now();
+      std::jthread([] {}).join();
+      double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+      start = i == 0 ? elapsed : std::min(start, elapsed);
+    }
+    thresholds.threaded_min_work = 2.0 * start / std::max(per_work, 1e-3);
+    return thresholds;
+  }
+
+  // calibrated once, on first call; execute and tune_kernel take the uncalibrated thresholds unless passed these,
+  // so the calibration runs only where it is asked for
+  inline const Executor_Thresholds &executor_thresholds()
+  {
+    static const Executor_Thresholds thresholds = calibrate_executor();
+    return thresholds;
+  }
+
+  // evaluates over the columns with the backend the plan picks, and returns the plan for logging; the result
+  // is that of Expression::evaluate whatever the backend, unless Policy is Math_Policy::fast_math. thresholds
+  // default to the uncalibrated ones, which never start threads; pass executor_thresholds() for the calibrated ones
+  template <Math_Policy Policy = Math_Policy::exact, typename E>
+  Execution_Plan execute(const E &expression, std::initializer_list<ColumnBinding> column_bindings, std::span<double> result,
+                         const Executor_Thresholds &thresholds = {}, const Kernel_Tuning &tuning = {})
+  {
+    SYMBOLIC_MATH_TRACE_SCOPE("evaluate", "execute");
+    using Kernel = Column_Kernel<E>;
+    Execution_Plan plan = plan_execution<E, Policy>(result.size(), thresholds, tuning);
+    const typename Kernel::Columns columns = Kernel::resolve(column_bindings, result.size());
+    switch (plan.backend)
+    {
+    case Backend::scalar:
+      Kernel::scalar(expression, columns, result);
+      break;
+    case Backend::simd:
+      Kernel::template simd<Policy>(expression, columns, result, plan.block_size);
+      break;
+    case Backend::threaded:
+      Kernel::template threaded<Policy>(expression, columns, result, plan.threads, plan.blocked, plan.block_size);
+      break;
+    }
+    return plan;
+  }
+
+  // the same with uniform symbols, which always take the blocked kernel
+  template <typename E>
+  Execution_Plan execute(const E &expression, std::initializer_list<Binding> uniform_bindings, std::initializer_list<ColumnBinding> column_bindings,
+                         std::span<double> result, const Executor_Thresholds &thresholds = {}, const Kernel_Tuning &tuning = {})
+  {
+    SYMBOLIC_MATH_TRACE_SCOPE("evaluate", "execute");
+    using Kernel = Column_Kernel<E>;
+    Execution_Plan plan = plan_execution<E>(result.size(), thresholds, tuning);
+    plan.blocked = true;
+    auto [columns, uniforms] = Kernel::resolve(uniform_bindings, column_bindings, result.size());
+    if (plan.backend == Backend::threaded)
+    {
+      Kernel::threaded(expression, columns, result, plan.threads, true, plan.block_size, &uniforms);
+    }
+    else
+    {
+      plan.backend = Backend::simd;
+      Kernel::simd(expression, columns, result, plan.block_size, &uniforms);
+    }
+    return plan;
+  }
+
+}
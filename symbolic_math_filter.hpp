@@ -0,0 +1,425 @@
+//
+// symbolic_math_filter.hpp
+// predicates over expressions, from comparisons joined by && and ||, and a batch filter that evaluates one
+// as a mask and compacts the values of another expression at the selected rows in the same pass
+//
+// some ideas from https://www.youtube.com/watch?v=lPfA4SFojao
+// created using chatgpt and deepseek, improved by Farshid Mossaiby
+//
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include "symbolic_math.hpp"
+#include "symbolic_math_affine.hpp"
+#include "symbolic_math_executor.hpp"
+#include "symbolic_math_trace.hpp"
+
+namespace symbolic_math
+{
+
+  enum class Relation
+  {
+    less,
+    less_equal,
+    greater,
+    greater_equal
+  };
+
+  constexpr bool apply_relation(Relation relation, double lhs, double rhs)
+  {
+    switch (relation)
+    {
+    case Relation::less:
+      return lhs < rhs;
+    case Relation::less_equal:
+      return lhs <= rhs;
+    case Relation::greater:
+      return lhs > rhs;
+    default:
+      return lhs >= rhs;
+    }
+  }
+
+  constexpr const char *relation_symbol(Relation relation)
+  {
+    switch (relation)
+    {
+    case Relation::less:
+      return " < ";
+    case Relation::less_equal:
+      return " <= ";
+    case Relation::greater:
+      return " > ";
+    default:
+      return " >= ";
+    }
+  }
+
+  // false whenever a side is NaN, as the comparison operators of double. predicates are not symbolic, so
+  // arithmetic does not apply to them, but they have lhs and rhs like binary nodes, so symbol_tags finds
+  // the symbols under them
+  template <Relation R, typename LHS, typename RHS>
+  struct Compare
+  {
+    static constexpr Relation relation = R;
+    LHS lhs;
+    RHS rhs;
+    constexpr bool evaluate(std::initializer_list<Binding> bindings) const
+    {
+      return apply_relation(R, lhs.evaluate(bindings), rhs.evaluate(bindings));
+    }
+    constexpr std::string symbolic_evaluate(std::initializer_list<SymbolicBinding> symbolic_bindings) const
+    {
+      return "(" + lhs.symbolic_evaluate(symbolic_bindings) + relation_symbol(R) + rhs.symbolic_evaluate(symbolic_bindings) + ")";
+    }
+  };
+
+  // both sides are always evaluated; batches evaluate them as masks, where skipping one buys nothing
+  template <typename LHS, typename RHS>
+  struct Conjunction
+  {
+    LHS lhs;
+    RHS rhs;
+    constexpr bool evaluate(std::initializer_list<Binding> bindings) const
+    {
+      return lhs.evaluate(bindings) & rhs.evaluate(bindings);
+    }
+    constexpr std::string symbolic_evaluate(std::initializer_list<SymbolicBinding> symbolic_bindings) const
+    {
+      return "(" + lhs.symbolic_evaluate(symbolic_bindings) + " && " + rhs.symbolic_evaluate(symbolic_bindings) + ")";
+    }
+  };
+
+  template <typename LHS, typename RHS>
+  struct Disjunction
+  {
+    LHS lhs;
+    RHS rhs;
+    constexpr bool evaluate(std::initializer_list<Binding> bindings) const
+    {
+      return lhs.evaluate(bindings) | rhs.evaluate(bindings);
+    }
+    constexpr std::string symbolic_evaluate(std::initializer_list<SymbolicBinding> symbolic_bindings) const
+    {
+      return "(" + lhs.symbolic_evaluate(symbolic_bindings) + " || " + rhs.symbolic_evaluate(symbolic_bindings) + ")";
+    }
+  };
+
+  template <typename T>
+  struct is_comparison : std::false_type
+  {
+  };
+
+  template <Relation R, typename LHS, typename RHS>
+  struct is_comparison<Compare<R, LHS, RHS>> : std::true_type
+  {
+  };
+
+  template <typename T>
+  struct is_predicate : is_comparison<T>
+  {
+  };
+
+  template <typename LHS, typename RHS>
+  struct is_predicate<Conjunction<LHS, RHS>> : std::true_type
+  {
+  };
+
+  template <typename LHS, typename RHS>
+  struct is_predicate<Disjunction<LHS, RHS>> : std::true_type
+  {
+  };
+
+  template <typename T>
+  concept Predicate = is_predicate<std::remove_cv_t<T>>::value;
+
+  template <Symbolic LHS, Symbolic RHS>
+  constexpr auto operator<(const LHS &lhs, const RHS &rhs)
+  {
+    return Compare<Relation::less, LHS, RHS>{lhs, rhs};
+  }
+
+  template <Symbolic LHS, Symbolic RHS>
+  constexpr auto operator<=(const LHS &lhs, const RHS &rhs)
+  {
+    return Compare<Relation::less_equal, LHS, RHS>{lhs, rhs};
+  }
+
+  template <Symbolic LHS, Symbolic RHS>
+  constexpr auto operator>(const LHS &lhs, const RHS &rhs)
+  {
+    return Compare<Relation::greater, LHS, RHS>{lhs, rhs};
+  }
+
+  template <Symbolic LHS, Symbolic RHS>
+  constexpr auto operator>=(const LHS &lhs, const RHS &rhs)
+  {
+    return Compare<Relation::greater_equal, LHS, RHS>{lhs, rhs};
+  }
+
+  template <Symbolic T>
+  constexpr auto operator<(double d, const T &expression)
+  {
+    return make_constant(d) < expression;
+  }
+
+  template <Symbolic T>
+  constexpr auto operator<(const T &expression, double d)
+  {
+    return expression < make_constant(d);
+  }
+
+  template <Symbolic T>
+  constexpr auto operator<=(double d, const T &expression)
+  {
+    return make_constant(d) <= expression;
+  }
+
+  template <Symbolic T>
+  constexpr auto operator<=(const T &expression, double d)
+  {
+    return expression <= make_constant(d);
+  }
+
+  template <Symbolic T>
+  constexpr auto operator>(double d, const T &expression)
+  {
+    return make_constant(d) > expression;
+  }
+
+  template <Symbolic T>
+  constexpr auto operator>(const T &expression, double d)
+  {
+    return expression > make_constant(d);
+  }
+
+  template <Symbolic T>
+  constexpr auto operator>=(double d, const T &expression)
+  {
+    return make_constant(d) >= expression;
+  }
+
+  template <Symbolic T>
+  constexpr auto operator>=(const T &expression, double d)
+  {
+    return expression >= make_constant(d);
+  }
+
+  template <Predicate LHS, Predicate RHS>
+  constexpr auto operator&&(const LHS &lhs, const RHS &rhs)
+  {
+    return Conjunction<LHS, RHS>{lhs, rhs};
+  }
+
+  template <Predicate LHS, Predicate RHS>
+  constexpr auto operator||(const LHS &lhs, const RHS &rhs)
+  {
+    return Disjunction<LHS, RHS>{lhs, rhs};
+  }
+
+  // the predicate and the projection of a filter under one node, so one Column_Kernel resolves the
+  // columns of both
+  template <typename P, typename V>
+  struct Selection
+  {
+    P lhs;
+    V rhs;
+  };
+
+  // values[0, selected) = values[j] at the j in [0, count) where mask[j] is 1, in place, and selected;
+  // with AVX-512 eight values at a time through a compress, otherwise a branch-free store and advance
+  inline std::size_t compress(double *values, const std::uint8_t *mask, std::size_t count)
+  {
+    std::size_t selected = 0;
+    std::size_t j = 0;
+#if defined(__AVX512F__)
+    // the store writes all eight lanes, but never past j + 8, whose values are loaded already
+    for (; j + 8 <= count; j += 8)
+    {
+      __m512i lanes = _mm512_cvtepu8_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(mask + j)));
+      __mmask8 keep = _mm512_test_epi64_mask(lanes, lanes);
+      _mm512_storeu_pd(values + selected, _mm512_maskz_compress_pd(keep, _mm512_loadu_pd(values + j)));
+      selected += static_cast<std::size_t>(std::popcount(static_cast<unsigned>(keep)));
+    }
+#endif
+    for (; j < count; ++j)
+    {
+      values[selected] = values[j];
+      selected += mask[j];
+    }
+    return selected;
+  }
+
+  // masks of a predicate by blocks; the sides of every comparison that are not leaves are evaluated by the
+  // blocked kernel
+  template <typename P, typename V>
+  struct Filter_Kernel
+  {
+    using Kernel = Column_Kernel<Selection<P, V>>;
+    using Columns = typename Kernel::Columns;
+
+    // value scratch columns: the two sides of a comparison, then the scratch of evaluating either
+    template <typename Q>
+    static constexpr std::size_t value_levels()
+    {
+      if constexpr (is_comparison<Q>::value)
+      {
+        return 2 + std::max(Kernel::template levels<decltype(Q::lhs)>(), Kernel::template levels<decltype(Q::rhs)>());
+      }
+      else
+      {
+        return std::max(value_levels<decltype(Q::lhs)>(), value_levels<decltype(Q::rhs)>());
+      }
+    }
+
+    // mask scratch columns: one for every right side of && and || that is not a comparison, nested
+    template <typename Q>
+    static constexpr std::size_t mask_levels()
+    {
+      if constexpr (is_comparison<Q>::value)
+      {
+        return 0;
+      }
+      else
+      {
+        return std::max(mask_levels<decltype(Q::lhs)>(), 1 + mask_levels<decltype(Q::rhs)>());
+      }
+    }
+
+    // calls body with the values of one side of a comparison by index; symbols are read from their column
+    // and constants broadcast, as combine does, and other sides are evaluated into buffer
+    template <typename E, typename F>
+    static void side(const E &expression, const Columns &columns, std::size_t begin, std::size_t count, double *buffer, double *scratch,
+                     const F &body)
+    {
+      if constexpr (Kernel::template is_leaf<E> && E::operation == Operation::symbol)
+      {
+        const double *column = columns[symbol_index(Kernel::tags, E::tag)] + begin;
+        body([column](std::size_t j) { return column[j]; });
+      }
+      else if constexpr (Kernel::template is_leaf<E>)
+      {
+        const double value = expression.evaluate({});
+        body([value](std::size_t) { return value; });
+      }
+      else
+      {
+        Kernel::block(expression, columns, begin, count, buffer, scratch);
+        body([buffer](std::size_t j) { return buffer[j]; });
+      }
+    }
+
+    template <Relation R, typename LHS, typename RHS>
+    static void compare_into(std::uint8_t *out, std::size_t count, const LHS &lhs, const RHS &rhs)
+    {
+      for (std::size_t j = 0; j < count; ++j)
+      {
+        out[j] = apply_relation(R, lhs(j), rhs(j));
+      }
+    }
+
+    // out[0, count) is 1 where the predicate holds for the block at begin, 0 elsewhere
+    template <typename Q>
+    static void mask(const Q &predicate, const Columns &columns, std::size_t begin, std::size_t count, std::uint8_t *out, double *scratch,
+                     std::uint8_t *mask_scratch)
+    {
+      if constexpr (is_comparison<Q>::value)
+      {
+        side(predicate.lhs, columns, begin, count, scratch, scratch + 2 * count, [&](const auto &lhs)
+             { side(predicate.rhs, columns, begin, count, scratch + count, scratch + 2 * count, [&](const auto &rhs)
+                    { compare_into<Q::relation>(out, count, lhs, rhs); }); });
+      }
+      else
+      {
+        mask(predicate.lhs, columns, begin, count, out, scratch, mask_scratch);
+        mask(predicate.rhs, columns, begin, count, mask_scratch, scratch, mask_scratch + count);
+        for (std::size_t j = 0; j < count; ++j)
+        {
+          if constexpr (std::is_same_v<Q, Conjunction<decltype(Q::lhs), decltype(Q::rhs)>>)
+          {
+            out[j] &= mask_scratch[j];
+          }
+          else
+          {
+            out[j] |= mask_scratch[j];
+          }
+        }
+      }
+    }
+  };
+
+  // calls append(values, kept) with the values of projection at the rows of [0, size) where predicate holds,
+  // block by block in row order: the predicate becomes a mask, the projection is evaluated unless no row of
+  // the block is selected, and its selected values are compacted to the front of the block
+  template <Predicate P, Symbolic V, typename F>
+  void filter_blocks(const P &predicate, const V &projection, std::initializer_list<ColumnBinding> column_bindings, std::size_t size,
+                     std::size_t block_size, const F &append)
+  {
+    using Filter = Filter_Kernel<P, V>;
+    using Kernel = typename Filter::Kernel;
+    const typename Kernel::Columns columns = Kernel::resolve(column_bindings, size);
+    block_size = std::max<std::size_t>(1, block_size);
+
+    std::vector<double> values(block_size);
+    std::vector<double> scratch(std::max(Filter::template value_levels<P>(), Kernel::template levels<V>()) * block_size);
+    std::vector<std::uint8_t> selection((1 + Filter::template mask_levels<P>()) * block_size);
+    for (std::size_t begin = 0; begin < size; begin += block_size)
+    {
+      std::size_t count = std::min(block_size, size - begin);
+      Filter::mask(predicate, columns, begin, count, selection.data(), scratch.data(), selection.data() + block_size);
+      if (std::find(selection.begin(), selection.begin() + count, 1) == selection.begin() + count)
+      {
+        continue;
+      }
+      Kernel::block(projection, columns, begin, count, values.data(), scratch.data());
+      append(static_cast<const double *>(values.data()), compress(values.data(), selection.data(), count));
+    }
+  }
+
+  // result[0, selected) = projection at the selected rows, and selected; throws when result has no room
+  // for them, with the rows of the blocks before written
+  template <Predicate P, Symbolic V>
+  std::size_t filter_columns(const P &predicate, const V &projection, std::initializer_list<ColumnBinding> column_bindings, std::size_t size,
+                             std::span<double> result, std::size_t block_size = executor_block_size)
+  {
+    SYMBOLIC_MATH_TRACE_SCOPE("evaluate", "filter_columns");
+    std::size_t selected = 0;
+    filter_blocks(predicate, projection, column_bindings, size, block_size, [&](const double *values, std::size_t kept)
+                  {
+                    if (kept > result.size() - selected)
+                    {
+                      throw std::logic_error("symbolic_math: filter_columns: error: result is too small for the selected rows");
+                    }
+                    std::copy_n(values, kept, result.begin() + selected);
+                    selected += kept; });
+    return selected;
+  }
+
+  // the values of projection at the selected rows; the vector grows with them, not with size
+  template <Predicate P, Symbolic V>
+  std::vector<double> filter_columns(const P &predicate, const V &projection, std::initializer_list<ColumnBinding> column_bindings, std::size_t size,
+                                     std::size_t block_size = executor_block_size)
+  {
+    SYMBOLIC_MATH_TRACE_SCOPE("evaluate", "filter_columns");
+    std::vector<double> result;
+    filter_blocks(predicate, projection, column_bindings, size, block_size, [&](const double *values, std::size_t kept)
+                  { result.insert(result.end(), values, values + kept); });
+    return result;
+  }
+
+}
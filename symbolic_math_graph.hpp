@@ -0,0 +1,205 @@
+//
+// symbolic_math_graph.hpp
+// runtime expression graphs for symbolic_math.hpp
+//
+// some ideas from https://www.youtube.com/watch?v=lPfA4SFojao
+// created using chatgpt and deepseek, improved by Farshid Mossaiby
+//
+
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "symbolic_math.hpp"
+#include "symbolic_math_trace.hpp"
+
+namespace symbolic_math
+{
+
+  struct Node
+  {
+    Operation operation;
+    double value = 0.0;  // constants
+    Tag tag = nullptr;   // symbols and named constants
+    std::size_t lhs = 0; // operations
+    std::size_t rhs = 0;
+
+    bool operator==(const Node &other) const
+    {
+      return operation == other.operation && std::bit_cast<std::uint64_t>(value) == std::bit_cast<std::uint64_t>(other.value) &&
+             tag == other.tag && lhs == other.lhs && rhs == other.rhs;
+    }
+  };
+
+  struct Node_Hash
+  {
+    std::size_t operator()(const Node &node) const
+    {
+      std::uint64_t h = hash_combine(hash_seed, static_cast<std::uint64_t>(node.operation));
+      h = hash_combine(h, std::bit_cast<std::uint64_t>(node.value));
+      h = hash_combine(h, reinterpret_cast<std::uintptr_t>(node.tag));
+      h = hash_combine(h, node.lhs);
+      return static_cast<std::size_t>(hash_combine(h, node.rhs));
+    }
+  };
+
+  // a hash-consed expression dag; operands always precede the nodes using them,
+  // so equal subexpressions share one node and evaluation is a single forward pass
+
+  struct Graph
+  {
+    std::vector<Node> nodes;
+    std::size_t root = 0;
+
+    std::size_t add_node(const Node &node)
+    {
+      auto [it, inserted] = index.try_emplace(node, nodes.size());
+      if (inserted)
+      {
+        nodes.push_back(node);
+      }
+      return it->second;
+    }
+
+    std::size_t constant(double value, Tag tag = nullptr)
+    {
+      return add_node(Node{Operation::constant, value, tag});
+    }
+
+    std::size_t symbol(Tag tag)
+    {
+      return add_node(Node{Operation::symbol, 0.0, tag});
+    }
+
+    std::size_t operation(Operation operation, std::size_t lhs, std::size_t rhs)
+    {
+      if (lhs >= nodes.size() || rhs >= nodes.size())
+      {
+        throw std::logic_error("symbolic_math: Graph::operation: error: operand does not exist");
+      }
+      return add_node(Node{operation, 0.0, nullptr, lhs, rhs});
+    }
+
+    double evaluate(std::initializer_list<Binding> bindings) const
+    {
+      std::vector<double> values(nodes.size());
+      for (std::size_t i = 0; i < nodes.size(); ++i)
+      {
+        values[i] = evaluate_node(nodes[i], values, bindings);
+      }
+      return values.at(root);
+    }
+
+    std::string symbolic_evaluate(std::initializer_list<SymbolicBinding> symbolic_bindings) const
+    {
+      return symbolic_evaluate(root, symbolic_bindings);
+    }
+
+    std::string symbolic_evaluate(std::size_t i, std::initializer_list<SymbolicBinding> symbolic_bindings) const
+    {
+      const Node &node = nodes.at(i);
+      switch (node.operation)
+      {
+      case Operation::constant:
+      {
+        std::string name = get_symbolic_binding_name(node.tag, symbolic_bindings);
+        return name.length() == 0 ? std::format("{}", node.value) : name;
+      }
+      case Operation::symbol:
+        return get_symbolic_binding_name(node.tag, symbolic_bindings);
+      default:
+        return "(" + symbolic_evaluate(node.lhs, symbolic_bindings) + " " + operation_symbol(node.operation) + " " +
+               symbolic_evaluate(node.rhs, symbolic_bindings) + ")";
+      }
+    }
+
+    static double evaluate_node(const Node &node, const std::vector<double> &values, std::initializer_list<Binding> bindings)
+    {
+      switch (node.operation)
+      {
+      case Operation::constant:
+        return node.value;
+      case Operation::symbol:
+        return get_binding_value(node.tag, bindings);
+      case Operation::add:
+        return values[node.lhs] + values[node.rhs];
+      case Operation::subtract:
+        return values[node.lhs] - values[node.rhs];
+      case Operation::multiply:
+        return values[node.lhs] * values[node.rhs];
+      case Operation::divide:
+        return values[node.lhs] / values[node.rhs];
+      }
+      throw std::logic_error("symbolic_math: Graph::evaluate: error: unknown operation");
+    }
+
+    static std::string operation_symbol(Operation operation)
+    {
+      switch (operation)
+      {
+      case Operation::add:
+        return "+";
+      case Operation::subtract:
+        return "-";
+      case Operation::multiply:
+        return "*";
+      case Operation::divide:
+        return "/";
+      default:
+        return "?";
+      }
+    }
+
+  private:
+    std::unordered_map<Node, std::size_t, Node_Hash> index;
+  };
+
+  template <typename E>
+  std::size_t add_to_graph(Graph &graph, const E &expression)
+  {
+    if constexpr (is_expression<E>::value)
+    {
+      return add_to_graph(graph, expression.e);
+    }
+    else if constexpr (E::operation == Operation::constant)
+    {
+      return graph.constant(expression.value, E::tag);
+    }
+    else if constexpr (E::operation == Operation::symbol)
+    {
+      return graph.symbol(E::tag);
+    }
+    else if constexpr (Nary_Node<E>)
+    {
+      return apply_operands(expression, [&](const auto &first, const auto &...rest)
+                            {
+                              std::size_t i = add_to_graph(graph, first);
+                              ((i = graph.operation(E::operation, i, add_to_graph(graph, rest))), ...);
+                              return i; });
+    }
+    else
+    {
+      std::size_t lhs = add_to_graph(graph, expression.lhs);
+      std::size_t rhs = add_to_graph(graph, expression.rhs);
+      return graph.operation(E::operation, lhs, rhs);
+    }
+  }
+
+  template <typename E>
+  Graph to_graph(const E &expression)
+  {
+    SYMBOLIC_MATH_TRACE_SCOPE("compile", "to_graph");
+    Graph graph;
+    graph.root = add_to_graph(graph, expression);
+    return graph;
+  }
+
+}
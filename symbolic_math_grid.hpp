@@ -0,0 +1,319 @@
+//
+// symbolic_math_grid.hpp
+// evaluation over the tensor product of per-symbol axes, as a loop nest that evaluates every subtree at the
+// outermost loop level it depends on
+//
+// some ideas from https://www.youtube.com/watch?v=lPfA4SFojao
+// created using chatgpt and deepseek, improved by Farshid Mossaiby
+//
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "symbolic_math.hpp"
+#include "symbolic_math_affine.hpp"
+#include "symbolic_math_analysis.hpp"
+#include "symbolic_math_executor.hpp"
+#include "symbolic_math_trace.hpp"
+
+namespace symbolic_math
+{
+
+  // every node of the expression has an id, in preorder, and a level: 0 when it depends on no axis, and
+  // otherwise one past the innermost axis among its symbols. a node of level k is evaluated once per
+  // iteration of loop k and cached, the nodes of the innermost level are evaluated in blocks along the
+  // innermost axis, and the others are broadcast from the cache there
+  template <typename Root>
+  struct Grid_Kernel
+  {
+    using Kernel = Column_Kernel<Root>;
+    static constexpr auto tags = Kernel::tags;
+
+    template <typename E>
+    static constexpr std::size_t node_count()
+    {
+      if constexpr (is_expression<E>::value)
+      {
+        return node_count<decltype(E::e)>();
+      }
+      else if constexpr (Binary_Node<E>)
+      {
+        return 1 + node_count<decltype(E::lhs)>() + node_count<decltype(E::rhs)>();
+      }
+      else if constexpr (Nary_Node<E>)
+      {
+        return []<std::size_t... I>(std::index_sequence<I...>)
+        { return 1 + (node_count<operand_t<I, E>>() + ...); }(std::make_index_sequence<E::arity>{});
+      }
+      else
+      {
+        return 1;
+      }
+    }
+
+    // id of operand I of the n-ary node E with id Id
+    template <std::size_t Id, std::size_t I, typename E>
+    static constexpr std::size_t operand_id()
+    {
+      return []<std::size_t... J>(std::index_sequence<J...>)
+      { return Id + 1 + (0 + ... + node_count<operand_t<J, E>>()); }(std::make_index_sequence<I>{});
+    }
+
+    static constexpr std::size_t nodes = node_count<std::remove_cv_t<Root>>();
+
+    struct State
+    {
+      std::array<std::size_t, nodes> levels{};
+      std::array<double, nodes> cache{};
+      std::array<std::size_t, tags.size()> symbol_levels{};
+      std::array<double, tags.size()> current{}; // the value of each symbol at the current outer iteration
+      std::size_t inner = 0;                     // level of the innermost axis
+      const double *column = nullptr;            // the values of the innermost axis
+    };
+
+    template <std::size_t Id, typename E>
+    static std::size_t assign_levels(State &state)
+    {
+      if constexpr (is_expression<E>::value)
+      {
+        return assign_levels<Id, decltype(E::e)>(state);
+      }
+      else if constexpr (Binary_Node<E>)
+      {
+        constexpr std::size_t rhs = Id + 1 + node_count<decltype(E::lhs)>();
+        return state.levels[Id] = std::max(assign_levels<Id + 1, decltype(E::lhs)>(state), assign_levels<rhs, decltype(E::rhs)>(state));
+      }
+      else if constexpr (Nary_Node<E>)
+      {
+        return state.levels[Id] = []<std::size_t... I>(State &state, std::index_sequence<I...>)
+        { return std::max({assign_levels<operand_id<Id, I, E>(), operand_t<I, E>>(state)...}); }(state, std::make_index_sequence<E::arity>{});
+      }
+      else if constexpr (E::operation == Operation::symbol)
+      {
+        return state.levels[Id] = state.symbol_levels[symbol_index(tags, E::tag)];
+      }
+      else
+      {
+        return state.levels[Id] = 0;
+      }
+    }
+
+    // caches the nodes of level exactly level; those below are cached already, and those above only searched
+    template <std::size_t Id, typename E>
+    static void evaluate_level(const E &expression, std::size_t level, State &state)
+    {
+      if constexpr (is_expression<E>::value)
+      {
+        evaluate_level<Id>(expression.e, level, state);
+      }
+      else
+      {
+        if (state.levels[Id] < level)
+        {
+          return;
+        }
+        if constexpr (Binary_Node<E>)
+        {
+          constexpr std::size_t rhs = Id + 1 + node_count<decltype(E::lhs)>();
+          evaluate_level<Id + 1>(expression.lhs, level, state);
+          evaluate_level<rhs>(expression.rhs, level, state);
+          if (state.levels[Id] == level)
+          {
+            state.cache[Id] = apply_operation(E::operation, state.cache[Id + 1], state.cache[rhs]);
+          }
+        }
+        else if constexpr (Nary_Node<E>)
+        {
+          [&]<std::size_t... I>(std::index_sequence<I...>)
+          {
+            (evaluate_level<operand_id<Id, I, E>()>(get_operand<I>(expression.operands), level, state), ...);
+          }(std::make_index_sequence<E::arity>{});
+          if (state.levels[Id] == level)
+          {
+            state.cache[Id] = [&]<std::size_t... I>(std::index_sequence<I...>)
+            {
+              double result = state.cache[operand_id<Id, 0, E>()];
+              ((result = apply_operation(E::operation, result, state.cache[operand_id<Id, I + 1, E>()])), ...);
+              return result;
+            }(std::make_index_sequence<E::arity - 1>{});
+          }
+        }
+        else if constexpr (E::operation == Operation::symbol)
+        {
+          state.cache[Id] = state.current[symbol_index(tags, E::tag)];
+        }
+        else
+        {
+          state.cache[Id] = expression.evaluate({});
+        }
+      }
+    }
+
+    // out[0, count) for the block at begin of the innermost axis, as Column_Kernel::block
+    template <std::size_t Id, typename E>
+    static void block(const E &expression, std::size_t begin, std::size_t count, double *out, double *scratch, const State &state)
+    {
+      if constexpr (is_expression<E>::value)
+      {
+        block<Id>(expression.e, begin, count, out, scratch, state);
+      }
+      else if (state.levels[Id] < state.inner)
+      {
+        std::fill_n(out, count, state.cache[Id]);
+      }
+      else if constexpr (Binary_Node<E>)
+      {
+        block<Id + 1>(expression.lhs, begin, count, out, scratch, state);
+        combine<Id + 1 + node_count<decltype(E::lhs)>()>(E::operation, expression.rhs, begin, count, out, scratch, state);
+      }
+      else if constexpr (Nary_Node<E>)
+      {
+        [&]<std::size_t... I>(std::index_sequence<I...>)
+        {
+          block<operand_id<Id, 0, E>()>(get_operand<0>(expression.operands), begin, count, out, scratch, state);
+          (combine<operand_id<Id, I + 1, E>()>(E::operation, get_operand<I + 1>(expression.operands), begin, count, out, scratch, state), ...);
+        }(std::make_index_sequence<E::arity - 1>{});
+      }
+      else
+      {
+        // a symbol of the innermost axis; constants are level 0 and always cached
+        std::copy_n(state.column + begin, count, out);
+      }
+    }
+
+    template <std::size_t Id, typename E>
+    static void combine(Operation operation, const E &operand, std::size_t begin, std::size_t count, double *out, double *scratch,
+                        const State &state)
+    {
+      if (state.levels[Id] < state.inner)
+      {
+        const double value = state.cache[Id];
+        Kernel::combine_into(operation, out, count, [value](std::size_t) { return value; });
+      }
+      else if constexpr (Kernel::template is_leaf<E>)
+      {
+        // as in block, a leaf not cached is a symbol of the innermost axis
+        const double *column = state.column + begin;
+        Kernel::combine_into(operation, out, count, [column](std::size_t j) { return column[j]; });
+      }
+      else
+      {
+        block<Id>(operand, begin, count, scratch, scratch + count, state);
+        Kernel::combine_into(operation, out, count, [scratch](std::size_t j) { return scratch[j]; });
+      }
+    }
+  };
+
+  // result[((i0 * n1 + i1) * n2 + i2) ...] = expression at axis 0 [i0], axis 1 [i1], ... in the order of the
+  // bindings, so the last axis is contiguous and vectorized; put the axis most of the expression depends on
+  // last, since only the nodes depending on it are evaluated per element
+  template <typename E>
+  void evaluate_grid(const E &expression, std::initializer_list<ColumnBinding> axes, std::span<double> result,
+                     std::size_t block_size = executor_block_size)
+  {
+    SYMBOLIC_MATH_TRACE_SCOPE("evaluate", "evaluate_grid");
+    using Grid = Grid_Kernel<E>;
+    using State = typename Grid::State;
+    if (axes.size() == 0)
+    {
+      throw std::logic_error("symbolic_math: evaluate_grid: error: no axes");
+    }
+    std::size_t size = 1;
+    for (const ColumnBinding &axis : axes)
+    {
+      size *= axis.values.size();
+    }
+    if (result.size() != size)
+    {
+      throw std::logic_error("symbolic_math: evaluate_grid: error: result size is not the product of the axis sizes");
+    }
+    if (size == 0)
+    {
+      return;
+    }
+
+    const ColumnBinding *axis = axes.begin();
+    State state;
+    state.inner = axes.size();
+    for (std::size_t i = 0; i < Grid::tags.size(); ++i)
+    {
+      auto bound = std::find_if(axes.begin(), axes.end(), [i](const ColumnBinding &binding)
+                                { return binding.tag == Grid::tags[i]; });
+      if (bound == axes.end())
+      {
+        throw std::logic_error("symbolic_math: evaluate_grid: error: undefined symbol in expression");
+      }
+      state.symbol_levels[i] = static_cast<std::size_t>(bound - axes.begin()) + 1;
+    }
+    Grid::template assign_levels<0, E>(state);
+    Grid::template evaluate_level<0>(expression, 0, state);
+    // the outer levels some node is cached at; an axis nothing depends on is only looped over
+    std::vector<char> cached(axes.size());
+    for (std::size_t level : state.levels)
+    {
+      if (level < state.inner)
+      {
+        cached[level] = 1;
+      }
+    }
+
+    block_size = std::max<std::size_t>(1, block_size);
+    const std::span<const double> inner = axis[axes.size() - 1].values;
+    state.column = inner.data();
+    std::vector<double> scratch(Column_Kernel<E>::template levels<E>() * block_size);
+
+    // loop k runs over axis k; the innermost axis is one row of the result, in blocks
+    auto loop = [&](auto &self, std::size_t k, std::size_t row) -> void
+    {
+      if (k + 1 == axes.size())
+      {
+        double *out = result.data() + row * inner.size();
+        for (std::size_t begin = 0; begin < inner.size(); begin += block_size)
+        {
+          std::size_t count = std::min(block_size, inner.size() - begin);
+          Grid::template block<0>(expression, begin, count, out + begin, scratch.data(), state);
+        }
+        return;
+      }
+      for (std::size_t i = 0; i < axis[k].values.size(); ++i)
+      {
+        for (std::size_t s = 0; s < Grid::tags.size(); ++s)
+        {
+          if (state.symbol_levels[s] == k + 1)
+          {
+            state.current[s] = axis[k].values[i];
+          }
+        }
+        // the innermost level is never cached; it is evaluated per block above
+        if (k + 1 < axes.size() && cached[k + 1])
+        {
+          Grid::template evaluate_level<0>(expression, k + 1, state);
+        }
+        self(self, k + 1, row * axis[k].values.size() + i);
+      }
+    };
+    loop(loop, 0, 0);
+  }
+
+  template <typename E>
+  std::vector<double> evaluate_grid(const E &expression, std::initializer_list<ColumnBinding> axes, std::size_t block_size = executor_block_size)
+  {
+    std::size_t size = 1;
+    for (const ColumnBinding &axis : axes)
+    {
+      size *= axis.values.size();
+    }
+    std::vector<double> result(size);
+    evaluate_grid(expression, axes, result, block_size);
+    return result;
+  }
+
+}
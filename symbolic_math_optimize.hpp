@@ -0,0 +1,658 @@
+//
+// symbolic_math_optimize.hpp
+// compile-time optimization passes for symbolic_math.hpp expressions
+//
+// some ideas from https://www.youtube.com/watch?v=lPfA4SFojao
+// created using chatgpt and deepseek, improved by Farshid Mossaiby
+//
+
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "symbolic_math.hpp"
+
+namespace symbolic_math
+{
+
+  // passes that may change rounding only transform expressions under Math_Policy::fast_math,
+  // and return them unchanged under Math_Policy::exact
+  enum class Math_Policy
+  {
+    exact,
+    fast_math
+  };
+
+  // reassociation of Add and Multiply chains into balanced trees
+  // a left-to-right chain of n operands has a critical path of n - 1 operations, a balanced tree of about log2(n),
+  // and pairwise summation also bounds the rounding error by O(log n) instead of O(n)
+
+  template <typename E>
+  constexpr auto reassociate_balanced(const E &expression);
+
+  template <Operation Op, typename E>
+  constexpr auto flatten_chain(const E &expression)
+  {
+    if constexpr (Binary_Node<E> && E::operation == Op)
+    {
+      return std::tuple_cat(flatten_chain<Op>(expression.lhs), flatten_chain<Op>(expression.rhs));
+    }
+    else if constexpr (Nary_Node<E> && E::operation == Op)
+    {
+      return apply_operands(expression, [](const auto &...operand) { return std::tuple_cat(flatten_chain<Op>(operand)...); });
+    }
+    else
+    {
+      return std::tuple(reassociate_balanced(expression));
+    }
+  }
+
+  template <Operation Op, std::size_t Begin, std::size_t End, typename Chain>
+  constexpr auto balance_chain(const Chain &operands)
+  {
+    if constexpr (End - Begin == 1)
+    {
+      return std::get<Begin>(operands);
+    }
+    else
+    {
+      constexpr std::size_t middle = Begin + (End - Begin) / 2;
+      auto lhs = balance_chain<Op, Begin, middle>(operands);
+      auto rhs = balance_chain<Op, middle, End>(operands);
+      return binary_node_t<Op, decltype(lhs), decltype(rhs)>{lhs, rhs};
+    }
+  }
+
+  template <typename E>
+  constexpr auto reassociate_balanced(const E &expression)
+  {
+    if constexpr (is_expression<E>::value)
+    {
+      return Expression(reassociate_balanced(expression.e));
+    }
+    else if constexpr ((Binary_Node<E> || Nary_Node<E>) && is_associative(E::operation))
+    {
+      auto operands = flatten_chain<E::operation>(expression);
+      return balance_chain<E::operation, 0, std::tuple_size_v<decltype(operands)>>(operands);
+    }
+    else if constexpr (Binary_Node<E>)
+    {
+      auto lhs = reassociate_balanced(expression.lhs);
+      auto rhs = reassociate_balanced(expression.rhs);
+      return rebind_node_t<E, decltype(lhs), decltype(rhs)>{lhs, rhs};
+    }
+    else
+    {
+      return expression;
+    }
+  }
+
+  template <Math_Policy Policy, typename E>
+  constexpr auto reassociate(const E &expression)
+  {
+    if constexpr (Policy == Math_Policy::fast_math)
+    {
+      return reassociate_balanced(expression);
+    }
+    else
+    {
+      return expression;
+    }
+  }
+
+  // constant folding: symbol-free subtrees of Rational constants fold exactly into one Rational,
+  // other symbol-free subtrees into one Constant, evaluated from their folded operands
+
+  template <typename E>
+  constexpr auto fold_constants(const E &expression);
+
+  template <typename E>
+  constexpr auto fold_constants_node(const E &expression)
+  {
+    if constexpr (Binary_Node<E>)
+    {
+      auto lhs = fold_constants(expression.lhs);
+      auto rhs = fold_constants(expression.rhs);
+      if constexpr (is_rational<decltype(lhs)>::value && is_rational<decltype(rhs)>::value)
+      {
+        return fold_rational<E::operation, decltype(lhs), decltype(rhs)>();
+      }
+      else
+      {
+        return make_constant(rebind_node_t<E, decltype(lhs), decltype(rhs)>{lhs, rhs}.evaluate({}));
+      }
+    }
+    else if constexpr (Nary_Node<E>)
+    {
+      return apply_operands(expression, [](const auto &...operand)
+                            {
+                              if constexpr ((is_rational<decltype(fold_constants(operand))>::value && ...))
+                              {
+                                if constexpr (E::operation == Operation::add)
+                                {
+                                  return (... + fold_constants(operand));
+                                }
+                                else
+                                {
+                                  return (... * fold_constants(operand));
+                                }
+                              }
+                              else
+                              {
+                                return make_constant(rebuild_nary<E>(fold_constants(operand)...).evaluate({}));
+                              } });
+    }
+    else
+    {
+      return expression;
+    }
+  }
+
+  template <typename E>
+  constexpr auto fold_constants(const E &expression)
+  {
+    if constexpr (is_expression<E>::value)
+    {
+      return Expression(fold_constants(expression.e));
+    }
+    else if constexpr (is_symbol_free<E>())
+    {
+      return fold_constants_node(expression);
+    }
+    else if constexpr (Binary_Node<E>)
+    {
+      auto lhs = fold_constants(expression.lhs);
+      auto rhs = fold_constants(expression.rhs);
+      return rebind_node_t<E, decltype(lhs), decltype(rhs)>{lhs, rhs};
+    }
+    else if constexpr (Nary_Node<E>)
+    {
+      return apply_operands(expression, [](const auto &...operand) { return rebuild_nary<E>(fold_constants(operand)...); });
+    }
+    else
+    {
+      return expression;
+    }
+  }
+
+  // division minimization: a rational subexpression becomes one numerator over one denominator,
+  // e.g. a / b / c → a / (b * c) and a / b + c / d → (a * d + c * b) / (b * d), so it performs at most one divide;
+  // the products can overflow or round differently, so the form with bindings and a tolerance below checks the result
+
+  struct No_Denominator
+  {
+  };
+
+  template <typename N, typename D>
+  struct Quotient
+  {
+    N numerator;
+    D denominator;
+  };
+
+  template <typename LHS, typename RHS>
+  constexpr auto multiply_factors(const LHS &lhs, const RHS &rhs)
+  {
+    if constexpr (std::is_same_v<LHS, No_Denominator>)
+    {
+      return rhs;
+    }
+    else if constexpr (std::is_same_v<RHS, No_Denominator>)
+    {
+      return lhs;
+    }
+    else
+    {
+      return Multiply<LHS, RHS>{lhs, rhs};
+    }
+  }
+
+  // a / d ± b / d → (a ± b) / d; constants of one type can hold different values, so only a constant-free
+  // denominator is the same whenever its type is
+  template <typename D1, typename D2>
+  constexpr bool shares_denominator()
+  {
+    return std::is_same_v<D1, D2> && (std::is_same_v<D1, No_Denominator> || is_constant_free<D1>());
+  }
+
+  template <Operation Op, typename N1, typename D1, typename N2, typename D2>
+  constexpr auto combine_quotient(const Quotient<N1, D1> &lhs, const Quotient<N2, D2> &rhs)
+  {
+    if constexpr (Op == Operation::multiply)
+    {
+      auto numerator = multiply_factors(lhs.numerator, rhs.numerator);
+      auto denominator = multiply_factors(lhs.denominator, rhs.denominator);
+      return Quotient<decltype(numerator), decltype(denominator)>{numerator, denominator};
+    }
+    else if constexpr (Op == Operation::divide)
+    {
+      auto numerator = multiply_factors(lhs.numerator, rhs.denominator);
+      auto denominator = multiply_factors(lhs.denominator, rhs.numerator);
+      return Quotient<decltype(numerator), decltype(denominator)>{numerator, denominator};
+    }
+    else if constexpr (shares_denominator<D1, D2>())
+    {
+      return Quotient<binary_node_t<Op, N1, N2>, D1>{{lhs.numerator, rhs.numerator}, lhs.denominator};
+    }
+    else
+    {
+      auto l = multiply_factors(lhs.numerator, rhs.denominator);
+      auto r = multiply_factors(rhs.numerator, lhs.denominator);
+      auto denominator = multiply_factors(lhs.denominator, rhs.denominator);
+      return Quotient<binary_node_t<Op, decltype(l), decltype(r)>, decltype(denominator)>{{l, r}, denominator};
+    }
+  }
+
+  // left fold of the operands of an n-ary node
+  template <Operation Op, typename Q>
+  struct Quotient_Fold
+  {
+    Q quotient;
+  };
+
+  template <Operation Op, typename Q1, typename Q2>
+  constexpr auto operator|(const Quotient_Fold<Op, Q1> &lhs, const Quotient_Fold<Op, Q2> &rhs)
+  {
+    auto quotient = combine_quotient<Op>(lhs.quotient, rhs.quotient);
+    return Quotient_Fold<Op, decltype(quotient)>{quotient};
+  }
+
+  template <typename E>
+  constexpr bool contains_divide()
+  {
+    if constexpr (Binary_Node<E>)
+    {
+      return E::operation == Operation::divide || contains_divide<decltype(E::lhs)>() || contains_divide<decltype(E::rhs)>();
+    }
+    else if constexpr (Nary_Node<E>)
+    {
+      return []<std::size_t... I>(std::index_sequence<I...>)
+      { return (contains_divide<operand_t<I, E>>() || ...); }(std::make_index_sequence<E::arity>{});
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+  template <typename E>
+  constexpr auto to_quotient(const E &expression)
+  {
+    if constexpr (!contains_divide<E>())
+    {
+      return Quotient<E, No_Denominator>{expression, {}};
+    }
+    else if constexpr (Binary_Node<E>)
+    {
+      return combine_quotient<E::operation>(to_quotient(expression.lhs), to_quotient(expression.rhs));
+    }
+    else
+    {
+      return apply_operands(expression, [](const auto &...operand)
+                            { return (... | Quotient_Fold<E::operation, decltype(to_quotient(operand))>{to_quotient(operand)}).quotient; });
+    }
+  }
+
+  template <typename N, typename D>
+  constexpr auto from_quotient(const Quotient<N, D> &quotient)
+  {
+    if constexpr (std::is_same_v<D, No_Denominator>)
+    {
+      return quotient.numerator;
+    }
+    else
+    {
+      return Divide<N, D>{quotient.numerator, quotient.denominator};
+    }
+  }
+
+  template <typename E>
+  constexpr auto combine_quotients_node(const E &expression)
+  {
+    return from_quotient(to_quotient(expression));
+  }
+
+  template <Math_Policy Policy, typename E>
+  constexpr auto combine_quotients(const E &expression)
+  {
+    if constexpr (Policy == Math_Policy::exact)
+    {
+      return expression;
+    }
+    else if constexpr (is_expression<E>::value)
+    {
+      return Expression(combine_quotients_node(expression.e));
+    }
+    else
+    {
+      return combine_quotients_node(expression);
+    }
+  }
+
+  // strength reduction of costly operations on binary nodes
+  // rules on constants need their values at compile time, so they apply to constants whose type holds the value,
+  // e.g. Rational<1, 4>; strength_reduce<E>() takes the expression as a template argument, so it knows all of them:
+  //   x / c → x * (1 / c)          exact when c and 1 / c are both ±2^k, otherwise fast_math only if 1 / c is finite
+  //   x * 2 → x + x                exact; only for symbols, since a repeated subexpression is evaluated twice
+  //   a / d ± b / d → (a ± b) / d  fast_math only, as combine_quotient does it
+
+  constexpr bool is_power_of_two(double d)
+  {
+    std::uint64_t bits = std::bit_cast<std::uint64_t>(d);
+    std::uint64_t exponent = (bits >> 52) & 0x7ff;
+    std::uint64_t mantissa = bits & ((std::uint64_t(1) << 52) - 1);
+    if (exponent == 0x7ff)
+    {
+      return false;
+    }
+    else if (exponent == 0)
+    {
+      return mantissa != 0 && (mantissa & (mantissa - 1)) == 0;
+    }
+    else
+    {
+      return mantissa == 0;
+    }
+  }
+
+  // 1 / d is finite, so it can be folded at compile time
+  constexpr bool has_finite_reciprocal(double d)
+  {
+    double magnitude = d < 0.0 ? -d : d;
+    return magnitude > 0x1p-1024 && magnitude <= std::numeric_limits<double>::max();
+  }
+
+  // x / d and x * (1 / d) round the same real number when 1 / d is exact
+  constexpr bool has_exact_reciprocal(double d)
+  {
+    return is_power_of_two(d) && has_finite_reciprocal(d);
+  }
+
+  // a constant of type C whose value V is part of the type, as strength_reduce<E>() sees it
+  template <double V, typename C>
+  struct Known_Constant : C
+  {
+    using constant_type = C;
+    static constexpr double value = V;
+    constexpr Known_Constant(const C &constant) : C(constant) {}
+  };
+
+  template <typename T>
+  struct is_known_constant : std::false_type
+  {
+  };
+
+  template <double V, typename C>
+  struct is_known_constant<Known_Constant<V, C>> : std::true_type
+  {
+  };
+
+  template <typename T>
+  constexpr bool has_known_value()
+  {
+    return T::operation == Operation::constant && (is_known_constant<T>::value || is_rational<T>::value);
+  }
+
+  template <auto E>
+  constexpr auto know_constants()
+  {
+    using T = std::remove_cv_t<decltype(E)>;
+    if constexpr (is_expression<T>::value)
+    {
+      return Expression(know_constants<E.e>());
+    }
+    else if constexpr (Binary_Node<T>)
+    {
+      constexpr auto lhs = know_constants<E.lhs>();
+      constexpr auto rhs = know_constants<E.rhs>();
+      return rebind_node_t<T, std::remove_cv_t<decltype(lhs)>, std::remove_cv_t<decltype(rhs)>>{lhs, rhs};
+    }
+    else if constexpr (Nary_Node<T>)
+    {
+      return []<std::size_t... I>(std::index_sequence<I...>)
+      { return rebuild_nary<T>(know_constants<get_operand<I>(E.operands)>()...); }(std::make_index_sequence<T::arity>{});
+    }
+    else if constexpr (T::operation == Operation::constant && !has_known_value<T>())
+    {
+      return Known_Constant<E.value, T>(E);
+    }
+    else
+    {
+      return E;
+    }
+  }
+
+  template <typename E>
+  constexpr auto forget_constants(const E &expression)
+  {
+    if constexpr (Binary_Node<E>)
+    {
+      auto lhs = forget_constants(expression.lhs);
+      auto rhs = forget_constants(expression.rhs);
+      return rebind_node_t<E, decltype(lhs), decltype(rhs)>{lhs, rhs};
+    }
+    else if constexpr (Nary_Node<E>)
+    {
+      return apply_operands(expression, [](const auto &...operand) { return rebuild_nary<E>(forget_constants(operand)...); });
+    }
+    else if constexpr (is_known_constant<E>::value)
+    {
+      return static_cast<const typename E::constant_type &>(expression);
+    }
+    else
+    {
+      return expression;
+    }
+  }
+
+  template <Math_Policy Policy, typename E>
+  constexpr auto strength_reduce_at(const E &expression)
+  {
+    if constexpr (Binary_Node<E>)
+    {
+      using L = std::remove_cv_t<decltype(expression.lhs)>;
+      using R = std::remove_cv_t<decltype(expression.rhs)>;
+      if constexpr (E::operation == Operation::divide && has_known_value<R>())
+      {
+        if constexpr (has_exact_reciprocal(R::value) || (Policy == Math_Policy::fast_math && has_finite_reciprocal(R::value)))
+        {
+          using Reciprocal = Known_Constant<1.0 / R::value, decltype(make_constant(0.0))>;
+          return strength_reduce_at<Policy>(Multiply<L, Reciprocal>{expression.lhs, Reciprocal(make_constant(1.0 / R::value))});
+        }
+        else
+        {
+          return expression;
+        }
+      }
+      else if constexpr (E::operation == Operation::multiply && L::operation == Operation::symbol && has_known_value<R>())
+      {
+        if constexpr (R::value == 2.0)
+        {
+          return Add<L, L>{expression.lhs, expression.lhs};
+        }
+        else
+        {
+          return expression;
+        }
+      }
+      else if constexpr (E::operation == Operation::multiply && has_known_value<L>() && R::operation == Operation::symbol)
+      {
+        if constexpr (L::value == 2.0)
+        {
+          return Add<R, R>{expression.rhs, expression.rhs};
+        }
+        else
+        {
+          return expression;
+        }
+      }
+      else if constexpr (Policy == Math_Policy::fast_math && (E::operation == Operation::add || E::operation == Operation::subtract) &&
+                         L::operation == Operation::divide && R::operation == Operation::divide)
+      {
+        using N1 = std::remove_cv_t<decltype(expression.lhs.lhs)>;
+        using D1 = std::remove_cv_t<decltype(expression.lhs.rhs)>;
+        using N2 = std::remove_cv_t<decltype(expression.rhs.lhs)>;
+        using D2 = std::remove_cv_t<decltype(expression.rhs.rhs)>;
+        if constexpr (shares_denominator<D1, D2>())
+        {
+          return from_quotient(combine_quotient<E::operation>(Quotient<N1, D1>{expression.lhs.lhs, expression.lhs.rhs},
+                                                               Quotient<N2, D2>{expression.rhs.lhs, expression.rhs.rhs}));
+        }
+        else
+        {
+          return expression;
+        }
+      }
+      else
+      {
+        return expression;
+      }
+    }
+    else
+    {
+      return expression;
+    }
+  }
+
+  template <Math_Policy Policy, typename E>
+  constexpr auto strength_reduce_node(const E &expression)
+  {
+    if constexpr (Binary_Node<E>)
+    {
+      auto lhs = strength_reduce_node<Policy>(expression.lhs);
+      auto rhs = strength_reduce_node<Policy>(expression.rhs);
+      return strength_reduce_at<Policy>(rebind_node_t<E, decltype(lhs), decltype(rhs)>{lhs, rhs});
+    }
+    else if constexpr (Nary_Node<E>)
+    {
+      return apply_operands(expression, [](const auto &...operand) { return rebuild_nary<E>(strength_reduce_node<Policy>(operand)...); });
+    }
+    else
+    {
+      return expression;
+    }
+  }
+
+  // only exact rules apply unless Policy is Math_Policy::fast_math, e.g. strength_reduce(x / Rational<4>{});
+  // a Constant is left as it is, its value is not known from its type
+  template <Math_Policy Policy = Math_Policy::exact, typename E>
+  constexpr auto strength_reduce(const E &expression)
+  {
+    if constexpr (is_expression<E>::value)
+    {
+      return Expression(strength_reduce<Policy>(expression.e));
+    }
+    else
+    {
+      return forget_constants(strength_reduce_node<Policy>(expression));
+    }
+  }
+
+  // the same with the values of all constants, e.g. strength_reduce<x / 2.0>()
+  template <auto E, Math_Policy Policy = Math_Policy::exact>
+  constexpr auto strength_reduce()
+  {
+    return strength_reduce<Policy>(know_constants<E>());
+  }
+
+  // first-order running error bound: the value computed at the given bindings is within bound of the exact value,
+  // taking bindings and constants as exact and each operation as rounding by at most half an ulp;
+  // comparing the bounds before and after a fast_math pass at representative bindings guards the rewrite
+
+  struct Error_Bound
+  {
+    double value;
+    double bound;
+  };
+
+  constexpr double magnitude(double d)
+  {
+    return d < 0.0 ? -d : d;
+  }
+
+  constexpr Error_Bound combine_error_bound(Operation operation, const Error_Bound &lhs, const Error_Bound &rhs)
+  {
+    constexpr double unit_roundoff = std::numeric_limits<double>::epsilon() / 2.0;
+    switch (operation)
+    {
+    case Operation::add:
+    {
+      double value = lhs.value + rhs.value;
+      return Error_Bound{value, lhs.bound + rhs.bound + unit_roundoff * magnitude(value)};
+    }
+    case Operation::subtract:
+    {
+      double value = lhs.value - rhs.value;
+      return Error_Bound{value, lhs.bound + rhs.bound + unit_roundoff * magnitude(value)};
+    }
+    case Operation::multiply:
+    {
+      double value = lhs.value * rhs.value;
+      return Error_Bound{value, magnitude(rhs.value) * lhs.bound + magnitude(lhs.value) * rhs.bound + unit_roundoff * magnitude(value)};
+    }
+    case Operation::divide:
+    {
+      double value = lhs.value / rhs.value;
+      return Error_Bound{value, (lhs.bound + magnitude(value) * rhs.bound) / magnitude(rhs.value) + unit_roundoff * magnitude(value)};
+    }
+    default:
+      throw std::logic_error("symbolic_math: combine_error_bound: error: not a binary operation");
+    }
+  }
+
+  template <typename E>
+  constexpr Error_Bound error_bound(const E &expression, std::initializer_list<Binding> bindings)
+  {
+    if constexpr (is_expression<E>::value)
+    {
+      return error_bound(expression.e, bindings);
+    }
+    else if constexpr (Binary_Node<E>)
+    {
+      return combine_error_bound(E::operation, error_bound(expression.lhs, bindings), error_bound(expression.rhs, bindings));
+    }
+    else if constexpr (Nary_Node<E>)
+    {
+      return apply_operands(expression, [&](const auto &first, const auto &...rest)
+                            {
+                              Error_Bound result = error_bound(first, bindings);
+                              ((result = combine_error_bound(E::operation, result, error_bound(rest, bindings))), ...);
+                              return result; });
+    }
+    else
+    {
+      return Error_Bound{expression.evaluate(bindings), 0.0};
+    }
+  }
+
+  // combine_quotients guarded by error_bound: the combined form is kept when its bound at the sample bindings
+  // is at most tolerance, otherwise evaluate falls back to the expression, e.g. when b * d overflows
+  template <typename E, typename Combined>
+  struct Guarded_Quotients
+  {
+    E expression;
+    Combined combined;
+    bool accepted;
+
+    constexpr double evaluate(std::initializer_list<Binding> bindings) const
+    {
+      return accepted ? combined.evaluate(bindings) : expression.evaluate(bindings);
+    }
+  };
+
+  template <Math_Policy Policy, typename E>
+  constexpr auto combine_quotients(const E &expression, std::initializer_list<Binding> bindings, double tolerance)
+  {
+    auto combined = combine_quotients<Policy>(expression);
+    return Guarded_Quotients<E, decltype(combined)>{expression, combined, error_bound(combined, bindings).bound <= tolerance};
+  }
+
+}
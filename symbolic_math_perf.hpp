@@ -0,0 +1,221 @@
+//
+// symbolic_math_perf.hpp
+// hardware performance counters around batch evaluation, through linux perf_event_open
+//
+// some ideas from https://www.youtube.com/watch?v=lPfA4SFojao
+// created using chatgpt and deepseek, improved by Farshid Mossaiby
+//
+
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <span>
+#include <string>
+#include <utility>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "symbolic_math.hpp"
+#include "symbolic_math_affine.hpp"
+#include "symbolic_math_executor.hpp"
+
+namespace symbolic_math
+{
+
+  // counts of one measured region; all zero, with available false, when the counters could not be opened
+  struct Perf_Counters
+  {
+    bool available = false;
+    std::uint64_t cycles = 0;
+    std::uint64_t instructions = 0;
+    std::uint64_t cache_misses = 0;
+    std::uint64_t branch_misses = 0;
+    std::size_t bytes = 0; // bytes the region reads and writes, as declared by the caller
+
+    double ipc() const
+    {
+      return cycles == 0 ? 0.0 : static_cast<double>(instructions) / static_cast<double>(cycles);
+    }
+
+    // a kernel far below the machine's bandwidth per cycle, at a high ipc, is compute bound
+    double bytes_per_cycle() const
+    {
+      return cycles == 0 ? 0.0 : static_cast<double>(bytes) / static_cast<double>(cycles);
+    }
+
+    Perf_Counters &operator+=(const Perf_Counters &other)
+    {
+      available = available || other.available;
+      cycles += other.cycles;
+      instructions += other.instructions;
+      cache_misses += other.cache_misses;
+      branch_misses += other.branch_misses;
+      bytes += other.bytes;
+      return *this;
+    }
+  };
+
+  // one group of user-space counters for the calling thread, read together so their ratios are consistent;
+  // with threads, also for the threads it starts once the group is open, as a threaded kernel does. when
+  // the kernel denies access, e.g. under perf_event_paranoid or in a container, measure still runs the
+  // body and error() says why there are no counts
+  class Perf_Event_Group
+  {
+  public:
+    explicit Perf_Event_Group(bool threads = false)
+    {
+#if defined(__linux__)
+      constexpr std::array<std::uint64_t, event_count> events{PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                              PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+      for (std::size_t i = 0; i < event_count; ++i)
+      {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = events[i];
+        attr.disabled = i == 0 ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.inherit = threads ? 1 : 0;
+        attr.read_format = PERF_FORMAT_GROUP;
+        int leader = i == 0 ? -1 : descriptors[0];
+        descriptors[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+        if (descriptors[i] < 0)
+        {
+          message = std::string("perf_event_open: ") + std::strerror(errno);
+          if (errno == EACCES || errno == EPERM)
+          {
+            message += " (see /proc/sys/kernel/perf_event_paranoid)";
+          }
+          else if (errno == ENOENT || errno == EOPNOTSUPP)
+          {
+            message += " (no hardware counters, e.g. in a virtual machine)";
+          }
+          close_all();
+          return;
+        }
+      }
+#else
+      message = "hardware counters need linux perf_event_open";
+#endif
+    }
+
+    ~Perf_Event_Group()
+    {
+      close_all();
+    }
+
+    Perf_Event_Group(const Perf_Event_Group &) = delete;
+    Perf_Event_Group &operator=(const Perf_Event_Group &) = delete;
+
+    bool available() const
+    {
+      return descriptors[0] >= 0;
+    }
+
+    const std::string &error() const
+    {
+      return message;
+    }
+
+    template <typename F>
+    Perf_Counters measure(std::size_t bytes, F &&body)
+    {
+      Perf_Counters counters;
+      counters.bytes = bytes;
+      if (!available())
+      {
+        std::forward<F>(body)();
+        return counters;
+      }
+
+#if defined(__linux__)
+      // a reset leaves the counts of exited inheriting threads, so the region is the difference of two reads
+      std::array<std::uint64_t, 1 + event_count> before{}, values{};
+      ioctl(descriptors[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      bool read_before = read_group(before);
+      ioctl(descriptors[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+      std::forward<F>(body)();
+      ioctl(descriptors[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+      if (!read_before || !read_group(values))
+      {
+        return counters;
+      }
+      counters.available = true;
+      counters.cycles = values[1] - before[1];
+      counters.instructions = values[2] - before[2];
+      counters.cache_misses = values[3] - before[3];
+      counters.branch_misses = values[4] - before[4];
+#endif
+      return counters;
+    }
+
+  private:
+    static constexpr std::size_t event_count = 4;
+
+#if defined(__linux__)
+    // PERF_FORMAT_GROUP reads the number of events, then one value per event in opening order
+    bool read_group(std::array<std::uint64_t, 1 + event_count> &values) const
+    {
+      return read(descriptors[0], values.data(), sizeof(values)) == static_cast<ssize_t>(sizeof(values)) && values[0] == event_count;
+    }
+#endif
+
+    void close_all()
+    {
+#if defined(__linux__)
+      for (int &descriptor : descriptors)
+      {
+        if (descriptor >= 0)
+        {
+          close(descriptor);
+        }
+        descriptor = -1;
+      }
+#endif
+    }
+
+    std::array<int, event_count> descriptors{-1, -1, -1, -1};
+    std::string message;
+  };
+
+  // Affine_Form::evaluate over columns, counted; it reads every bound column once and writes the result once
+  template <std::size_t N>
+  Perf_Counters evaluate_counted(Perf_Event_Group &group, const Affine_Form<N> &form, std::initializer_list<ColumnBinding> column_bindings,
+                                 std::span<double> result)
+  {
+    return group.measure((N + 1) * result.size() * sizeof(double), [&]
+                         { form.evaluate(column_bindings, result); });
+  }
+
+  // evaluate_columns_simd, counted; it reads every bound column once and writes the result once
+  template <Math_Policy Policy = Math_Policy::exact, Symbolic E>
+  Perf_Counters evaluate_counted(Perf_Event_Group &group, const E &expression, std::initializer_list<ColumnBinding> column_bindings,
+                                 std::span<double> result, std::size_t block_size = executor_block_size)
+  {
+    return group.measure((column_bindings.size() + 1) * result.size() * sizeof(double), [&]
+                         { evaluate_columns_simd<Policy>(expression, column_bindings, result, block_size); });
+  }
+
+  // evaluate_columns_threaded, counted; only a group opened with threads counts the work of its threads
+  template <Math_Policy Policy = Math_Policy::exact, Symbolic E>
+  Perf_Counters evaluate_counted_threaded(Perf_Event_Group &group, const E &expression, std::initializer_list<ColumnBinding> column_bindings,
+                                          std::span<double> result, std::size_t threads, bool blocked = true,
+                                          std::size_t block_size = executor_block_size)
+  {
+    return group.measure((column_bindings.size() + 1) * result.size() * sizeof(double), [&]
+                         { evaluate_columns_threaded<Policy>(expression, column_bindings, result, threads, blocked, block_size); });
+  }
+
+}
@@ -0,0 +1,243 @@
+//
+// symbolic_math_profile.hpp
+// sampled per-node cycle profiles of runtime graph evaluation
+//
+// some ideas from https://www.youtube.com/watch?v=lPfA4SFojao
+// created using chatgpt and deepseek, improved by Farshid Mossaiby
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "symbolic_math.hpp"
+#include "symbolic_math_graph.hpp"
+
+namespace symbolic_math
+{
+
+  // time stamp counter where available, steady clock nanoseconds otherwise; the fences keep the work being
+  // timed from overlapping the reads, which matters when that work is a single arithmetic instruction
+  inline std::uint64_t cycle_counter()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_lfence();
+    std::uint64_t cycles = __rdtsc();
+    _mm_lfence();
+    return cycles;
+#else
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+  }
+
+  // the smallest difference between two back-to-back reads, subtracted from every timed node
+  inline std::uint64_t cycle_counter_overhead()
+  {
+    static const std::uint64_t overhead = []
+    {
+      std::uint64_t minimum = UINT64_MAX;
+      for (int i = 0; i < 1000; ++i)
+      {
+        std::uint64_t start = cycle_counter();
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        std::uint64_t stop = cycle_counter();
+        minimum = std::min(minimum, stop - start);
+      }
+      return minimum;
+    }();
+    return overhead;
+  }
+
+  struct Node_Profile
+  {
+    std::uint64_t cycles = 0; // summed over the sampled evaluations
+    std::uint64_t calls = 0;
+  };
+
+  // only every sample_period-th evaluation is timed node by node, the others run the plain forward pass,
+  // so the profile costs about (timed pass / plain pass) / sample_period of the evaluation time
+  struct Graph_Profile
+  {
+    std::size_t sample_period = 1024;
+    std::size_t evaluations = 0;
+    std::size_t next_sample = 0;
+    std::size_t samples = 0;
+    std::vector<Node_Profile> nodes;
+
+    // average cycles of node i per sampled evaluation
+    double cycles(std::size_t i) const
+    {
+      return samples == 0 || i >= nodes.size() ? 0.0 : static_cast<double>(nodes[i].cycles) / static_cast<double>(samples);
+    }
+
+    void reset()
+    {
+      evaluations = 0;
+      next_sample = 0;
+      samples = 0;
+      nodes.clear();
+    }
+  };
+
+  // one evaluation timed node by node
+  inline double evaluate_sampled(const Graph &graph, std::initializer_list<Binding> bindings, Graph_Profile &profile)
+  {
+    const std::uint64_t overhead = cycle_counter_overhead();
+    profile.nodes.resize(graph.nodes.size());
+    std::vector<double> values(graph.nodes.size());
+    for (std::size_t i = 0; i < graph.nodes.size(); ++i)
+    {
+      std::uint64_t start = cycle_counter();
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+      values[i] = Graph::evaluate_node(graph.nodes[i], values, bindings);
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+      std::uint64_t elapsed = cycle_counter() - start;
+      profile.nodes[i].cycles += elapsed > overhead ? elapsed - overhead : 0;
+      ++profile.nodes[i].calls;
+    }
+    ++profile.samples;
+    return values.at(graph.root);
+  }
+
+  inline double evaluate_profiled(const Graph &graph, std::initializer_list<Binding> bindings, Graph_Profile &profile)
+  {
+    // a comparison rather than a modulo, since a division would cost about as much as a small graph
+    if (profile.evaluations++ != profile.next_sample) [[likely]]
+    {
+      return graph.evaluate(bindings);
+    }
+    if (profile.sample_period == 0)
+    {
+      throw std::logic_error("symbolic_math: evaluate_profiled: error: sample period is zero");
+    }
+    profile.next_sample += profile.sample_period;
+    return evaluate_sampled(graph, bindings, profile);
+  }
+
+  // rendering; a node shared by several parents is evaluated once, so its cycles are reported under the
+  // first parent reaching it, depth first and left to right, and later occurrences only refer to it
+
+  inline std::string profile_node_label(const Graph &graph, std::size_t i, std::initializer_list<SymbolicBinding> symbolic_bindings)
+  {
+    const Node &node = graph.nodes.at(i);
+    switch (node.operation)
+    {
+    case Operation::constant:
+    case Operation::symbol:
+      return graph.symbolic_evaluate(i, symbolic_bindings);
+    default:
+      return Graph::operation_symbol(node.operation);
+    }
+  }
+
+  // cycles of i and of the nodes first reached through it
+  inline double profile_inclusive_cycles(const Graph &graph, const Graph_Profile &profile, std::size_t i, std::vector<bool> &visited)
+  {
+    if (visited[i])
+    {
+      return 0.0;
+    }
+    visited[i] = true;
+    const Node &node = graph.nodes[i];
+    double cycles = profile.cycles(i);
+    if (node.operation != Operation::constant && node.operation != Operation::symbol)
+    {
+      cycles += profile_inclusive_cycles(graph, profile, node.lhs, visited);
+      cycles += profile_inclusive_cycles(graph, profile, node.rhs, visited);
+    }
+    return cycles;
+  }
+
+  inline void annotate_profile(const Graph &graph, const Graph_Profile &profile, std::size_t i, std::size_t depth, double total,
+                               std::initializer_list<SymbolicBinding> symbolic_bindings, std::vector<bool> &visited, std::string &out)
+  {
+    std::string label = std::string(2 * depth, ' ') + profile_node_label(graph, i, symbolic_bindings);
+    if (visited[i])
+    {
+      out += std::format("{:<32} shared, node {}\n", label, i);
+      return;
+    }
+
+    std::vector<bool> reached = visited;
+    double inclusive = profile_inclusive_cycles(graph, profile, i, reached);
+    visited[i] = true;
+    out += std::format("{:<32} {:10.1f} {:10.1f} {:6.1f}%\n", label, profile.cycles(i), inclusive, total > 0.0 ? 100.0 * inclusive / total : 0.0);
+
+    const Node &node = graph.nodes[i];
+    if (node.operation != Operation::constant && node.operation != Operation::symbol)
+    {
+      annotate_profile(graph, profile, node.lhs, depth + 1, total, symbolic_bindings, visited, out);
+      annotate_profile(graph, profile, node.rhs, depth + 1, total, symbolic_bindings, visited, out);
+    }
+  }
+
+  inline void fold_profile(const Graph &graph, const Graph_Profile &profile, std::size_t i, const std::string &stack,
+                           std::initializer_list<SymbolicBinding> symbolic_bindings, std::vector<bool> &visited, std::string &out)
+  {
+    if (visited[i])
+    {
+      return;
+    }
+    visited[i] = true;
+
+    // frames are separated by ';' and the count by the last space, so neither may appear in a frame
+    std::string frame = std::format("{}[{}]", profile_node_label(graph, i, symbolic_bindings), i);
+    std::replace(frame.begin(), frame.end(), ';', ':');
+    std::replace(frame.begin(), frame.end(), ' ', '_');
+    std::string path = stack.empty() ? frame : stack + ";" + frame;
+    out += std::format("{} {}\n", path, i < profile.nodes.size() ? profile.nodes[i].cycles : 0);
+
+    const Node &node = graph.nodes[i];
+    if (node.operation != Operation::constant && node.operation != Operation::symbol)
+    {
+      fold_profile(graph, profile, node.lhs, path, symbolic_bindings, visited, out);
+      fold_profile(graph, profile, node.rhs, path, symbolic_bindings, visited, out);
+    }
+  }
+
+  // the graph as an indented tree, one node per line with its own and its subtree's average cycles per
+  // sampled evaluation, and the subtree's share of the whole evaluation
+  inline std::string annotated_symbolic_evaluate(const Graph &graph, const Graph_Profile &profile,
+                                                 std::initializer_list<SymbolicBinding> symbolic_bindings)
+  {
+    if (graph.nodes.empty())
+    {
+      return {};
+    }
+    std::vector<bool> visited(graph.nodes.size());
+    double total = profile_inclusive_cycles(graph, profile, graph.root, visited);
+    std::string out = std::format("{:<32} {:>10} {:>10} {:>7}\n", "node", "self", "total", "share");
+    visited.assign(graph.nodes.size(), false);
+    annotate_profile(graph, profile, graph.root, 0, total, symbolic_bindings, visited, out);
+    return out;
+  }
+
+  // one line per node, "root[i];...;node[j] cycles", the folded-stack input of flamegraph.pl and speedscope;
+  // the counts are the summed cycles of each node itself, and frames carry the node index to keep equal
+  // operations apart
+  inline std::string folded_stacks(const Graph &graph, const Graph_Profile &profile, std::initializer_list<SymbolicBinding> symbolic_bindings)
+  {
+    std::string out;
+    if (graph.nodes.empty())
+    {
+      return out;
+    }
+    std::vector<bool> visited(graph.nodes.size());
+    fold_profile(graph, profile, graph.root, {}, symbolic_bindings, visited, out);
+    return out;
+  }
+
+}
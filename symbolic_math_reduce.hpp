@@ -0,0 +1,387 @@
+//
+// symbolic_math_reduce.hpp
+// reductions fused into column batch evaluation: sum, mean, min, max and histograms of an expression over
+// columns, without writing its values out
+//
+// some ideas from https://www.youtube.com/watch?v=lPfA4SFojao
+// created using chatgpt and deepseek, improved by Farshid Mossaiby
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <initializer_list>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "symbolic_math.hpp"
+#include "symbolic_math_executor.hpp"
+#include "symbolic_math_trace.hpp"
+
+namespace symbolic_math
+{
+
+  // a sink folds blocks of values into a partial result and merges partials; reduce_columns merges them in
+  // an order fixed by the chunks alone, so a sink whose merge is not associative in floating point still
+  // gives the same result on any number of threads
+  template <typename S>
+  concept Reduction_Sink = requires(const S &sink, typename S::Partial &partial, const double *values, std::size_t count) {
+    { sink.partial() } -> std::same_as<typename S::Partial>;
+    sink.accumulate(partial, values, count);
+    sink.merge(partial, std::as_const(partial));
+    { sink.result(std::as_const(partial)) } -> std::same_as<typename S::Result>;
+  };
+
+  // pairwise, with four accumulators at the leaves so the compiler vectorizes them
+  inline double pairwise_sum(const double *values, std::size_t count)
+  {
+    if (count > 32)
+    {
+      std::size_t half = count / 2;
+      return pairwise_sum(values, half) + pairwise_sum(values + half, count - half);
+    }
+    double lanes[4] = {0.0, 0.0, 0.0, 0.0};
+    for (std::size_t j = 0; j < count; ++j)
+    {
+      lanes[j % 4] += values[j];
+    }
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  }
+
+  // a sum with the rounding error of every addition carried along (Neumaier)
+  struct Compensated_Sum
+  {
+    double sum = 0.0;
+    double compensation = 0.0;
+
+    void add(double value)
+    {
+      double t = sum + value;
+      compensation += std::abs(sum) >= std::abs(value) ? (sum - t) + value : (value - t) + sum;
+      sum = t;
+    }
+
+    void merge(const Compensated_Sum &other)
+    {
+      add(other.sum);
+      compensation += other.compensation;
+    }
+
+    double value() const
+    {
+      return sum + compensation;
+    }
+  };
+
+  struct Sum_Sink
+  {
+    using Partial = Compensated_Sum;
+    using Result = double;
+
+    Partial partial() const
+    {
+      return {};
+    }
+
+    void accumulate(Partial &partial, const double *values, std::size_t count) const
+    {
+      partial.add(pairwise_sum(values, count));
+    }
+
+    void merge(Partial &partial, const Partial &other) const
+    {
+      partial.merge(other);
+    }
+
+    Result result(const Partial &partial) const
+    {
+      return partial.value();
+    }
+  };
+
+  // NaN when there are no values
+  struct Mean_Sink
+  {
+    struct Partial
+    {
+      Compensated_Sum sum;
+      std::size_t count = 0;
+    };
+    using Result = double;
+
+    Partial partial() const
+    {
+      return {};
+    }
+
+    void accumulate(Partial &partial, const double *values, std::size_t count) const
+    {
+      partial.sum.add(pairwise_sum(values, count));
+      partial.count += count;
+    }
+
+    void merge(Partial &partial, const Partial &other) const
+    {
+      partial.sum.merge(other.sum);
+      partial.count += other.count;
+    }
+
+    Result result(const Partial &partial) const
+    {
+      return partial.count == 0 ? std::numeric_limits<double>::quiet_NaN() : partial.sum.value() / static_cast<double>(partial.count);
+    }
+  };
+
+  // the least of initial and the values in the order before, or NaN when any of them is NaN; four lanes and
+  // a separate NaN test keep the loop free of a serial dependency, so the compiler vectorizes it
+  template <typename Before>
+  double extremum(double initial, const double *values, std::size_t count, Before before)
+  {
+    double lanes[4] = {initial, initial, initial, initial};
+    bool nan = initial != initial;
+    std::size_t j = 0;
+    for (; j + 4 <= count; j += 4)
+    {
+      for (std::size_t k = 0; k < 4; ++k)
+      {
+        nan |= values[j + k] != values[j + k];
+        lanes[k] = before(values[j + k], lanes[k]) ? values[j + k] : lanes[k];
+      }
+    }
+    for (; j < count; ++j)
+    {
+      nan |= values[j] != values[j];
+      lanes[0] = before(values[j], lanes[0]) ? values[j] : lanes[0];
+    }
+    if (nan)
+    {
+      return std::numeric_limits<double>::quiet_NaN();
+    }
+    double result = lanes[0];
+    for (std::size_t k = 1; k < 4; ++k)
+    {
+      result = before(lanes[k], result) ? lanes[k] : result;
+    }
+    return result;
+  }
+
+  // NaN when any value is NaN, infinity when there are no values
+  struct Min_Sink
+  {
+    using Partial = double;
+    using Result = double;
+
+    Partial partial() const
+    {
+      return std::numeric_limits<double>::infinity();
+    }
+
+    void accumulate(Partial &partial, const double *values, std::size_t count) const
+    {
+      partial = extremum(partial, values, count, [](double value, double minimum) { return value < minimum; });
+    }
+
+    void merge(Partial &partial, const Partial &other) const
+    {
+      accumulate(partial, &other, 1);
+    }
+
+    Result result(const Partial &partial) const
+    {
+      return partial;
+    }
+  };
+
+  // NaN when any value is NaN, minus infinity when there are no values
+  struct Max_Sink
+  {
+    using Partial = double;
+    using Result = double;
+
+    Partial partial() const
+    {
+      return -std::numeric_limits<double>::infinity();
+    }
+
+    void accumulate(Partial &partial, const double *values, std::size_t count) const
+    {
+      partial = extremum(partial, values, count, [](double value, double maximum) { return value > maximum; });
+    }
+
+    void merge(Partial &partial, const Partial &other) const
+    {
+      accumulate(partial, &other, 1);
+    }
+
+    Result result(const Partial &partial) const
+    {
+      return partial;
+    }
+  };
+
+  struct Histogram
+  {
+    std::vector<std::size_t> counts; // of equal bins over [lower, upper)
+    std::size_t underflow = 0;
+    std::size_t overflow = 0; // including upper itself
+    std::size_t nan = 0;
+  };
+
+  struct Histogram_Sink
+  {
+    using Partial = Histogram;
+    using Result = Histogram;
+
+    double lower;
+    double upper;
+    std::size_t bins;
+
+    Histogram_Sink(double lower, double upper, std::size_t bins) : lower(lower), upper(upper), bins(bins)
+    {
+      if (bins == 0 || !(lower < upper))
+      {
+        throw std::logic_error("symbolic_math: Histogram_Sink: error: empty range or no bins");
+      }
+    }
+
+    Partial partial() const
+    {
+      return Histogram{std::vector<std::size_t>(bins), 0, 0, 0};
+    }
+
+    void accumulate(Partial &partial, const double *values, std::size_t count) const
+    {
+      const double scale = static_cast<double>(bins) / (upper - lower);
+      for (std::size_t j = 0; j < count; ++j)
+      {
+        double value = values[j];
+        if (value != value)
+        {
+          ++partial.nan;
+        }
+        else if (value < lower)
+        {
+          ++partial.underflow;
+        }
+        else if (value >= upper)
+        {
+          ++partial.overflow;
+        }
+        else
+        {
+          // rounding may put a value just below upper past the last bin
+          ++partial.counts[std::min(bins - 1, static_cast<std::size_t>((value - lower) * scale))];
+        }
+      }
+    }
+
+    void merge(Partial &partial, const Partial &other) const
+    {
+      for (std::size_t i = 0; i < bins; ++i)
+      {
+        partial.counts[i] += other.counts[i];
+      }
+      partial.underflow += other.underflow;
+      partial.overflow += other.overflow;
+      partial.nan += other.nan;
+    }
+
+    Result result(const Partial &partial) const
+    {
+      return partial;
+    }
+  };
+
+  // the chunks are the unit of work of a thread and of the merge order, so they fix the result, together
+  // with the block size; threads only decide which thread computes which chunk. thresholds pick the blocked
+  // kernel or the element loop, as for execute; they default to the uncalibrated ones, and executor_thresholds()
+  // gives the calibrated ones of this machine
+  struct Reduction_Options
+  {
+    std::size_t threads = 1;
+    std::size_t block_size = executor_block_size;
+    std::size_t chunk_size = 1 << 14;
+    Executor_Thresholds thresholds;
+  };
+
+  template <typename Partials, typename... Sinks, std::size_t... I>
+  Partials merge_reduction(std::vector<Partials> &partials, std::size_t begin, std::size_t end, const std::tuple<const Sinks &...> &sinks,
+                           std::index_sequence<I...>)
+  {
+    if (end - begin == 1)
+    {
+      return std::move(partials[begin]);
+    }
+    std::size_t middle = begin + (end - begin) / 2;
+    Partials lhs = merge_reduction<Partials>(partials, begin, middle, sinks, std::index_sequence<I...>{});
+    Partials rhs = merge_reduction<Partials>(partials, middle, end, sinks, std::index_sequence<I...>{});
+    (std::get<I>(sinks).merge(std::get<I>(lhs), std::get<I>(rhs)), ...);
+    return lhs;
+  }
+
+  // the sinks over the first size elements of expression, evaluated block by block as execute would and
+  // fed to every sink from a buffer of one block; the results come in the order of the sinks
+  template <typename E, Reduction_Sink... Sinks>
+  std::tuple<typename Sinks::Result...> reduce_columns(const E &expression, std::initializer_list<ColumnBinding> column_bindings, std::size_t size,
+                                                       const Reduction_Options &options, const Sinks &...sinks)
+  {
+    SYMBOLIC_MATH_TRACE_SCOPE("evaluate", "reduce_columns");
+    using Kernel = Column_Kernel<E>;
+    using Partials = std::tuple<typename Sinks::Partial...>;
+    const typename Kernel::Columns columns = Kernel::resolve(column_bindings, size);
+    const std::size_t chunk_size = std::max<std::size_t>(1, options.chunk_size);
+    const std::size_t block_size = std::clamp<std::size_t>(options.block_size, 1, chunk_size);
+    const bool blocked = count_operations<E>().operations() >= options.thresholds.simd_min_operations;
+    const std::size_t chunks = (size + chunk_size - 1) / chunk_size;
+
+    std::vector<Partials> partials(std::max<std::size_t>(1, chunks), Partials{sinks.partial()...});
+    auto run = [&](std::size_t first, std::size_t last)
+    {
+      std::vector<double> out(block_size);
+      std::vector<double> scratch(Kernel::template levels<E>() * block_size);
+      for (std::size_t chunk = first; chunk < last; ++chunk)
+      {
+        std::size_t end = std::min(size, (chunk + 1) * chunk_size);
+        for (std::size_t begin = chunk * chunk_size; begin < end; begin += block_size)
+        {
+          std::size_t count = std::min(block_size, end - begin);
+          if (blocked)
+          {
+            Kernel::block(expression, columns, begin, count, out.data(), scratch.data());
+          }
+          else
+          {
+            Kernel::scalar(expression, Kernel::offset(columns, begin), std::span(out.data(), count));
+          }
+          [&]<std::size_t... I>(std::index_sequence<I...>)
+          { (sinks.accumulate(std::get<I>(partials[chunk]), out.data(), count), ...); }(std::index_sequence_for<Sinks...>{});
+        }
+      }
+    };
+
+    const std::size_t threads = std::clamp<std::size_t>(options.threads, 1, std::max<std::size_t>(1, chunks));
+    const std::size_t per_thread = (chunks + threads - 1) / std::max<std::size_t>(1, threads);
+    {
+      std::vector<std::jthread> workers;
+      workers.reserve(threads - 1);
+      for (std::size_t first = per_thread; first < chunks; first += per_thread)
+      {
+        workers.emplace_back(run, first, std::min(chunks, first + per_thread));
+      }
+      run(0, std::min(chunks, per_thread));
+    }
+
+    Partials merged = merge_reduction<Partials>(partials, 0, partials.size(), std::tuple<const Sinks &...>(sinks...), std::index_sequence_for<Sinks...>{});
+    return [&]<std::size_t... I>(std::index_sequence<I...>)
+    { return std::tuple<typename Sinks::Result...>(sinks.result(std::get<I>(merged))...); }(std::index_sequence_for<Sinks...>{});
+  }
+
+}
@@ -0,0 +1,646 @@
+//
+// symbolic_math_rewrite.hpp
+// pattern → replacement rewrite rules for symbolic_math.hpp expressions and runtime graphs
+//
+// some ideas from https://www.youtube.com/watch?v=lPfA4SFojao
+// created using chatgpt and deepseek, improved by Farshid Mossaiby
+//
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "symbolic_math.hpp"
+#include "symbolic_math_graph.hpp"
+#include "symbolic_math_trace.hpp"
+
+namespace symbolic_math
+{
+
+  // pattern wildcards; a wildcard used twice in a pattern matches equal subexpressions only,
+  // and the same wildcard in the replacement stands for what it matched
+
+  template <std::size_t N>
+  struct Any
+  {
+    static constexpr std::size_t slot = N;
+  };
+
+  template <std::size_t N>
+  struct Any_Constant
+  {
+    static constexpr std::size_t slot = N;
+  };
+
+  template <std::size_t N>
+  struct is_symbolic<Any<N>> : std::true_type
+  {
+  };
+
+  template <std::size_t N>
+  struct is_symbolic<Any_Constant<N>> : std::true_type
+  {
+  };
+
+  template <typename T>
+  struct is_wildcard : std::false_type
+  {
+  };
+
+  template <std::size_t N>
+  struct is_wildcard<Any<N>> : std::true_type
+  {
+  };
+
+  template <std::size_t N>
+  struct is_wildcard<Any_Constant<N>> : std::true_type
+  {
+  };
+
+  template <typename T>
+  struct is_constant_wildcard : std::false_type
+  {
+  };
+
+  template <std::size_t N>
+  struct is_constant_wildcard<Any_Constant<N>> : std::true_type
+  {
+  };
+
+  namespace patterns
+  {
+    inline constexpr Any<0> _1;
+    inline constexpr Any<1> _2;
+    inline constexpr Any<2> _3;
+    inline constexpr Any_Constant<3> _c1;
+    inline constexpr Any_Constant<4> _c2;
+  }
+
+  template <typename Pattern, typename Replacement>
+  struct Rule
+  {
+    Pattern pattern;
+    Replacement replacement;
+  };
+
+  template <typename Pattern, typename Replacement>
+  Rule(Pattern, Replacement) -> Rule<Pattern, Replacement>;
+
+  // compile-time rewriting
+  // patterns are matched on types, so a constant in a pattern can only be matched through Any_Constant;
+  // a replacement is either a pattern or a callable taking the match, e.g.
+  //   Rule{_c1 * (_c2 * _1), [](const auto &m) { return make_constant(m[_c1].value * m[_c2].value) * m[_1]; }}
+
+  template <typename T>
+  struct dependent_false : std::false_type
+  {
+  };
+
+  // an n-ary node matches as the left-nested chain it evaluates as, so a binary pattern matches a prefix
+  // and the last operand of an AddN or MultiplyN, as it matches the chain in a graph
+  template <typename P, typename E>
+  constexpr bool matches_structure()
+  {
+    if constexpr (is_wildcard<P>::value)
+    {
+      return !is_constant_wildcard<P>::value || E::operation == Operation::constant;
+    }
+    else if constexpr (P::operation == Operation::constant)
+    {
+      static_assert(dependent_false<P>::value, "symbolic_math: rewrite: error: use Any_Constant to match constants at compile time");
+      return false;
+    }
+    else if constexpr (P::operation == Operation::symbol)
+    {
+      return std::is_same_v<P, E>;
+    }
+    else if constexpr (Binary_Node<P> && Binary_Node<E>)
+    {
+      if constexpr (P::operation == E::operation)
+      {
+        return matches_structure<decltype(P::lhs), decltype(E::lhs)>() && matches_structure<decltype(P::rhs), decltype(E::rhs)>();
+      }
+      else
+      {
+        return false;
+      }
+    }
+    else if constexpr (Nary_Node<P> && Nary_Node<E>)
+    {
+      if constexpr (P::operation != E::operation)
+      {
+        return false;
+      }
+      else if constexpr (P::arity == E::arity)
+      {
+        return []<std::size_t... I>(std::index_sequence<I...>)
+        { return (matches_structure<operand_t<I, P>, operand_t<I, E>>() && ...); }(std::make_index_sequence<P::arity>{});
+      }
+      else
+      {
+        return matches_structure<binary_view_t<P>, binary_view_t<E>>();
+      }
+    }
+    else if constexpr (Binary_Node<P> && Nary_Node<E>)
+    {
+      return matches_structure<P, binary_view_t<E>>();
+    }
+    else if constexpr (Nary_Node<P> && Binary_Node<E>)
+    {
+      return matches_structure<binary_view_t<P>, E>();
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+  template <std::size_t N, typename T>
+  struct Bound
+  {
+    static constexpr std::size_t slot = N;
+    using type = T;
+    T expression;
+  };
+
+  template <typename P, typename E>
+  constexpr auto bind_pattern(const E &expression)
+  {
+    if constexpr (is_wildcard<P>::value)
+    {
+      return std::tuple<Bound<P::slot, E>>{Bound<P::slot, E>{expression}};
+    }
+    else if constexpr (Binary_Node<P> && Nary_Node<E>)
+    {
+      return bind_pattern<P>(binary_view(expression));
+    }
+    else if constexpr (Binary_Node<P>)
+    {
+      return std::tuple_cat(bind_pattern<decltype(P::lhs)>(expression.lhs), bind_pattern<decltype(P::rhs)>(expression.rhs));
+    }
+    else if constexpr (Nary_Node<P> && Nary_Node<E>)
+    {
+      if constexpr (P::arity == E::arity)
+      {
+        return [&]<std::size_t... I>(std::index_sequence<I...>)
+        { return std::tuple_cat(bind_pattern<operand_t<I, P>>(get_operand<I>(expression.operands))...); }(std::make_index_sequence<P::arity>{});
+      }
+      else
+      {
+        return bind_pattern<binary_view_t<P>>(binary_view(expression));
+      }
+    }
+    else if constexpr (Nary_Node<P>)
+    {
+      return bind_pattern<binary_view_t<P>>(expression);
+    }
+    else
+    {
+      return std::tuple<>{};
+    }
+  }
+
+  // a slot bound more than once must bind the same constant-free type, since constant values are not part of types
+  template <typename S, typename... Slots>
+  constexpr bool consistent_slot()
+  {
+    constexpr std::size_t occurrences = (0 + ... + (S::slot == Slots::slot ? 1 : 0));
+    return occurrences == 1 ||
+           (is_constant_free<typename S::type>() && ((S::slot != Slots::slot || std::is_same_v<typename S::type, typename Slots::type>) && ...));
+  }
+
+  template <typename... Slots>
+  struct Match
+  {
+    std::tuple<Slots...> slots;
+
+    static constexpr bool consistent = (consistent_slot<Slots, Slots...>() && ...);
+
+    template <std::size_t N>
+    static constexpr std::size_t index_of()
+    {
+      std::size_t i = 0;
+      ((Slots::slot == N ? false : (++i, true)) && ...);
+      return i;
+    }
+
+    template <typename W>
+      requires is_wildcard<W>::value
+    constexpr const auto &operator[](W) const
+    {
+      static_assert(index_of<W::slot>() < sizeof...(Slots), "symbolic_math: rewrite: error: wildcard is not bound by the pattern");
+      return std::get<index_of<W::slot>()>(slots).expression;
+    }
+  };
+
+  template <typename... Slots>
+  constexpr auto make_match(const std::tuple<Slots...> &slots)
+  {
+    return Match<Slots...>{slots};
+  }
+
+  template <typename R, typename E>
+  constexpr bool rule_applies()
+  {
+    using P = decltype(R::pattern);
+    if constexpr (matches_structure<P, E>())
+    {
+      return decltype(make_match(bind_pattern<P>(std::declval<const E &>())))::consistent;
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+  template <typename R, typename M>
+  constexpr auto instantiate(const R &replacement, const M &match)
+  {
+    if constexpr (std::is_invocable_v<const R &, const M &>)
+    {
+      return replacement(match);
+    }
+    else if constexpr (is_expression<R>::value)
+    {
+      return instantiate(replacement.e, match);
+    }
+    else if constexpr (is_wildcard<R>::value)
+    {
+      return match[replacement];
+    }
+    else if constexpr (Binary_Node<R>)
+    {
+      auto lhs = instantiate(replacement.lhs, match);
+      auto rhs = instantiate(replacement.rhs, match);
+      return rebind_node_t<R, decltype(lhs), decltype(rhs)>{lhs, rhs};
+    }
+    else if constexpr (Nary_Node<R>)
+    {
+      return apply_operands(replacement, [&](const auto &...operand) { return rebuild_nary<R>(instantiate(operand, match)...); });
+    }
+    else
+    {
+      return replacement;
+    }
+  }
+
+  inline constexpr std::size_t rewrite_step_limit = 64;
+
+  template <std::size_t Steps, typename E, typename... Rules>
+  constexpr auto rewrite_bottom_up(const E &expression, const std::tuple<Rules...> &rules);
+
+  template <std::size_t Steps, std::size_t I, typename E, typename... Rules>
+  constexpr auto apply_rules(const E &expression, const std::tuple<Rules...> &rules)
+  {
+    if constexpr (I == sizeof...(Rules))
+    {
+      return expression;
+    }
+    else if constexpr (rule_applies<std::tuple_element_t<I, std::tuple<Rules...>>, E>())
+    {
+      const auto &rule = std::get<I>(rules);
+      auto result = instantiate(rule.replacement, make_match(bind_pattern<decltype(rule.pattern)>(expression)));
+      if constexpr (is_expression<decltype(result)>::value)
+      {
+        return rewrite_bottom_up<Steps + 1>(result.e, rules);
+      }
+      else
+      {
+        return rewrite_bottom_up<Steps + 1>(result, rules);
+      }
+    }
+    else
+    {
+      return apply_rules<Steps, I + 1>(expression, rules);
+    }
+  }
+
+  // whether a rule's pattern is rooted at an operation node of Op, and so may match a link of an Op chain
+  template <Operation Op, typename... Rules>
+  constexpr bool matches_chain_links()
+  {
+    return ([]<typename P>()
+            {
+              if constexpr (Binary_Node<P> || Nary_Node<P>)
+              {
+                return P::operation == Op;
+              }
+              else
+              {
+                return false;
+              }
+            }.template operator()<std::remove_cvref_t<decltype(Rules::pattern)>>() ||
+            ...);
+  }
+
+  // the links of the n-ary chain of the first K operands of expression, whose operands are rewritten
+  // already, shortest first, as the graph rewriter visits the nodes of the chain: a link to which no rule
+  // applied keeps its operands n-ary, and the links after a rewritten one are binary nodes over it
+  template <std::size_t Steps, std::size_t K, typename E, typename... Rules>
+  constexpr auto rewrite_chain(const E &expression, const std::tuple<Rules...> &rules)
+  {
+    const auto &last = get_operand<K - 1>(expression.operands);
+    if constexpr (K == 2)
+    {
+      const auto &first = get_operand<0>(expression.operands);
+      return apply_rules<Steps, 0>(binary_node_t<E::operation, operand_t<0, E>, operand_t<1, E>>{first, last}, rules);
+    }
+    else
+    {
+      auto prefix = rewrite_chain<Steps, K - 1>(expression, rules);
+      using Unchanged = std::conditional_t<K == 3, binary_node_t<E::operation, operand_t<0, E>, operand_t<1, E>>,
+                                           typename nary_prefix<E, std::make_index_sequence<K - 1>>::type>;
+      if constexpr (std::is_same_v<decltype(prefix), Unchanged> && K == 3)
+      {
+        return apply_rules<Steps, 0>(rebuild_nary<E>(prefix.lhs, prefix.rhs, last), rules);
+      }
+      else if constexpr (std::is_same_v<decltype(prefix), Unchanged>)
+      {
+        return apply_rules<Steps, 0>(apply_operands(prefix, [&](const auto &...operand) { return rebuild_nary<E>(operand..., last); }), rules);
+      }
+      else
+      {
+        return apply_rules<Steps, 0>(binary_node_t<E::operation, decltype(prefix), operand_t<K - 1, E>>{prefix, last}, rules);
+      }
+    }
+  }
+
+  template <std::size_t Steps, typename E, typename... Rules>
+  constexpr auto rewrite_bottom_up(const E &expression, const std::tuple<Rules...> &rules)
+  {
+    if constexpr (Steps >= rewrite_step_limit)
+    {
+      static_assert(dependent_false<E>::value, "symbolic_math: rewrite: error: rules do not reach a fixpoint");
+      return expression;
+    }
+    else if constexpr (Binary_Node<E>)
+    {
+      auto lhs = rewrite_bottom_up<Steps>(expression.lhs, rules);
+      auto rhs = rewrite_bottom_up<Steps>(expression.rhs, rules);
+      return apply_rules<Steps, 0>(rebind_node_t<E, decltype(lhs), decltype(rhs)>{lhs, rhs}, rules);
+    }
+    else if constexpr (Nary_Node<E>)
+    {
+      auto operands = apply_operands(expression, [&](const auto &...operand) { return rebuild_nary<E>(rewrite_bottom_up<Steps>(operand, rules)...); });
+      if constexpr (matches_chain_links<E::operation, Rules...>())
+      {
+        return rewrite_chain<Steps, E::arity>(operands, rules);
+      }
+      else
+      {
+        return apply_rules<Steps, 0>(operands, rules);
+      }
+    }
+    else
+    {
+      return apply_rules<Steps, 0>(expression, rules);
+    }
+  }
+
+  // applies the first matching rule at each node, children first, until no rule matches
+  template <typename E, typename... Rules>
+  constexpr auto rewrite(const E &expression, const Rules &...rules)
+  {
+    if constexpr (is_expression<E>::value)
+    {
+      return Expression(rewrite(expression.e, rules...));
+    }
+    else
+    {
+      return rewrite_bottom_up<0>(expression, std::tuple<Rules...>(rules...));
+    }
+  }
+
+  // runtime rewriting on graphs
+  // constants in patterns match by value, and repeated wildcards match shared nodes; a replacement is
+  // a pattern or a callable std::size_t(Graph &, const Graph_Match &), and a guard is bool(const Graph &, const Graph_Match &)
+
+  struct Graph_Match
+  {
+    static constexpr std::size_t unbound = std::numeric_limits<std::size_t>::max();
+
+    std::vector<std::size_t> slots;
+
+    std::size_t &slot(std::size_t n)
+    {
+      if (slots.size() <= n)
+      {
+        slots.resize(n + 1, unbound);
+      }
+      return slots[n];
+    }
+
+    template <typename W>
+      requires is_wildcard<W>::value
+    std::size_t operator[](W) const
+    {
+      if (W::slot >= slots.size() || slots[W::slot] == unbound)
+      {
+        throw std::logic_error("symbolic_math: Graph_Match: error: wildcard is not bound by the pattern");
+      }
+      return slots[W::slot];
+    }
+  };
+
+  struct Graph_Rule
+  {
+    std::function<bool(const Graph &, std::size_t, Graph_Match &)> match;
+    std::function<std::size_t(Graph &, const Graph_Match &)> replace;
+  };
+
+  template <typename P>
+  bool match_graph(const P &pattern, const Graph &graph, std::size_t i, Graph_Match &match);
+
+  // matches operands 0 to K of an n-ary pattern against the left-nested chain ending at node i
+  template <std::size_t K, typename P>
+  bool match_graph_chain(const P &pattern, const Graph &graph, std::size_t i, Graph_Match &match)
+  {
+    if constexpr (K == 0)
+    {
+      return match_graph(get_operand<0>(pattern.operands), graph, i, match);
+    }
+    else
+    {
+      const Node &node = graph.nodes[i];
+      return node.operation == P::operation && match_graph_chain<K - 1>(pattern, graph, node.lhs, match) &&
+             match_graph(get_operand<K>(pattern.operands), graph, node.rhs, match);
+    }
+  }
+
+  template <typename P>
+  bool match_graph(const P &pattern, const Graph &graph, std::size_t i, Graph_Match &match)
+  {
+    const Node &node = graph.nodes[i];
+    if constexpr (is_expression<P>::value)
+    {
+      return match_graph(pattern.e, graph, i, match);
+    }
+    else if constexpr (is_wildcard<P>::value)
+    {
+      if (is_constant_wildcard<P>::value && node.operation != Operation::constant)
+      {
+        return false;
+      }
+      std::size_t &slot = match.slot(P::slot);
+      if (slot == Graph_Match::unbound)
+      {
+        slot = i;
+      }
+      return slot == i;
+    }
+    else if constexpr (P::operation == Operation::constant)
+    {
+      return node.operation == Operation::constant && node.value == pattern.value;
+    }
+    else if constexpr (P::operation == Operation::symbol)
+    {
+      return node.operation == Operation::symbol && node.tag == P::tag;
+    }
+    else if constexpr (Nary_Node<P>)
+    {
+      return match_graph_chain<P::arity - 1>(pattern, graph, i, match);
+    }
+    else
+    {
+      return node.operation == P::operation && match_graph(pattern.lhs, graph, node.lhs, match) &&
+             match_graph(pattern.rhs, graph, node.rhs, match);
+    }
+  }
+
+  template <typename R>
+  std::size_t instantiate_graph(const R &replacement, Graph &graph, const Graph_Match &match)
+  {
+    if constexpr (std::is_invocable_r_v<std::size_t, const R &, Graph &, const Graph_Match &>)
+    {
+      return replacement(graph, match);
+    }
+    else if constexpr (is_expression<R>::value)
+    {
+      return instantiate_graph(replacement.e, graph, match);
+    }
+    else if constexpr (is_wildcard<R>::value)
+    {
+      return match[replacement];
+    }
+    else if constexpr (R::operation == Operation::constant)
+    {
+      return graph.constant(replacement.value);
+    }
+    else if constexpr (R::operation == Operation::symbol)
+    {
+      return graph.symbol(R::tag);
+    }
+    else if constexpr (Nary_Node<R>)
+    {
+      return apply_operands(replacement, [&](const auto &first, const auto &...rest)
+                            {
+                              std::size_t i = instantiate_graph(first, graph, match);
+                              ((i = graph.operation(R::operation, i, instantiate_graph(rest, graph, match))), ...);
+                              return i; });
+    }
+    else
+    {
+      std::size_t lhs = instantiate_graph(replacement.lhs, graph, match);
+      std::size_t rhs = instantiate_graph(replacement.rhs, graph, match);
+      return graph.operation(R::operation, lhs, rhs);
+    }
+  }
+
+  template <typename P, typename R, typename G>
+  Graph_Rule make_graph_rule(const P &pattern, const R &replacement, const G &guard)
+  {
+    return Graph_Rule{[pattern, guard](const Graph &graph, std::size_t i, Graph_Match &match)
+                      { return match_graph(pattern, graph, i, match) && guard(graph, match); },
+                      [replacement](Graph &graph, const Graph_Match &match)
+                      { return instantiate_graph(replacement, graph, match); }};
+  }
+
+  template <typename P, typename R>
+  Graph_Rule make_graph_rule(const P &pattern, const R &replacement)
+  {
+    return make_graph_rule(pattern, replacement, [](const Graph &, const Graph_Match &) { return true; });
+  }
+
+  template <typename P, typename R>
+  Graph_Rule make_graph_rule(const Rule<P, R> &rule)
+  {
+    return make_graph_rule(rule.pattern, rule.replacement);
+  }
+
+  // rebuilds the nodes reachable from the root, applying the first matching rule at each node, children first;
+  // passes repeat until no rule fires, and step_limit bounds the total number of rule applications
+
+  inline Graph rewrite(const Graph &graph, const std::vector<Graph_Rule> &rules, std::size_t step_limit = 1 << 16)
+  {
+    SYMBOLIC_MATH_TRACE_SCOPE("optimize", "rewrite");
+    Graph current = graph;
+    std::size_t steps = 0;
+    for (bool changed = true; changed;)
+    {
+      changed = false;
+
+      std::vector<bool> reachable(current.nodes.size(), false);
+      reachable.at(current.root) = true;
+      for (std::size_t i = current.root + 1; i-- > 0;)
+      {
+        const Node &node = current.nodes[i];
+        if (reachable[i] && node.operation != Operation::constant && node.operation != Operation::symbol)
+        {
+          reachable[node.lhs] = reachable[node.rhs] = true;
+        }
+      }
+
+      Graph next;
+      std::vector<std::size_t> map(current.nodes.size(), Graph_Match::unbound);
+      for (std::size_t i = 0; i <= current.root; ++i)
+      {
+        if (!reachable[i])
+        {
+          continue;
+        }
+        Node node = current.nodes[i];
+        if (node.operation != Operation::constant && node.operation != Operation::symbol)
+        {
+          node.lhs = map[node.lhs];
+          node.rhs = map[node.rhs];
+        }
+        std::size_t j = next.add_node(node);
+        for (bool fired = true; fired;)
+        {
+          fired = false;
+          for (const auto &rule : rules)
+          {
+            Graph_Match match;
+            if (!rule.match(next, j, match))
+            {
+              continue;
+            }
+            std::size_t k = rule.replace(next, match);
+            if (k != j)
+            {
+              if (++steps > step_limit)
+              {
+                throw std::logic_error("symbolic_math: rewrite: error: rules do not reach a fixpoint");
+              }
+              j = k;
+              fired = changed = true;
+              break;
+            }
+          }
+        }
+        map[i] = j;
+      }
+      next.root = map[current.root];
+      current = std::move(next);
+    }
+    return current;
+  }
+
+}
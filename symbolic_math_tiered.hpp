@@ -0,0 +1,389 @@
+//
+// symbolic_math_tiered.hpp
+// tiered evaluation of runtime graphs: interpreted until hot, then compiled on a background thread and swapped in,
+// optionally specialized on the symbols whose bound values the interpreter saw constant
+//
+// some ideas from https://www.youtube.com/watch?v=lPfA4SFojao
+// created using chatgpt and deepseek, improved by Farshid Mossaiby
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "symbolic_math.hpp"
+#include "symbolic_math_analysis.hpp"
+#include "symbolic_math_egraph.hpp"
+#include "symbolic_math_graph.hpp"
+#include "symbolic_math_trace.hpp"
+
+namespace symbolic_math
+{
+
+  // a graph lowered to straight-line code over one register file: the symbols first, then the constants,
+  // preloaded, then one register per operation; operations on constants only are folded while lowering,
+  // and evaluation reuses a per-thread register file instead of allocating one per call
+  struct Compiled_Graph
+  {
+    struct Instruction
+    {
+      Operation operation;
+      std::size_t lhs;
+      std::size_t rhs;
+    };
+
+    std::vector<Tag> symbols;
+    std::vector<double> registers; // symbols and constants; the operations' registers follow
+    std::vector<Instruction> code; // instruction k writes register registers.size() + k
+    std::size_t root = 0;
+
+    double evaluate(std::initializer_list<Binding> bindings) const
+    {
+      thread_local std::vector<double> file;
+      file.resize(registers.size() + code.size());
+      std::copy(registers.begin(), registers.end(), file.begin());
+      for (std::size_t i = 0; i < symbols.size(); ++i)
+      {
+        file[i] = get_binding_value(symbols[i], bindings);
+      }
+      double *out = file.data() + registers.size();
+      for (const Instruction &instruction : code)
+      {
+        *out++ = apply_operation(instruction.operation, file[instruction.lhs], file[instruction.rhs]);
+      }
+      return file[root];
+    }
+  };
+
+  inline Compiled_Graph compile_graph(const Graph &graph)
+  {
+    SYMBOLIC_MATH_TRACE_SCOPE("compile", "compile_graph");
+    if (graph.nodes.empty())
+    {
+      throw std::logic_error("symbolic_math: compile_graph: error: graph is empty");
+    }
+
+    // constant values of the nodes that fold, and which nodes do
+    std::vector<double> values(graph.nodes.size());
+    std::vector<bool> folded(graph.nodes.size());
+    Compiled_Graph compiled;
+    std::size_t operations = 0;
+    for (std::size_t i = 0; i < graph.nodes.size(); ++i)
+    {
+      const Node &node = graph.nodes[i];
+      if (node.operation == Operation::symbol)
+      {
+        compiled.symbols.push_back(node.tag);
+      }
+      else if (node.operation == Operation::constant)
+      {
+        values[i] = node.value;
+        folded[i] = true;
+      }
+      else if (folded[node.lhs] && folded[node.rhs])
+      {
+        values[i] = apply_operation(node.operation, values[node.lhs], values[node.rhs]);
+        folded[i] = true;
+      }
+      else
+      {
+        ++operations;
+      }
+    }
+
+    std::vector<std::size_t> registers(graph.nodes.size());
+    std::size_t symbols = 0;
+    compiled.registers.assign(compiled.symbols.size(), 0.0);
+    for (std::size_t i = 0; i < graph.nodes.size(); ++i)
+    {
+      if (graph.nodes[i].operation == Operation::symbol)
+      {
+        registers[i] = symbols++;
+      }
+      else if (folded[i])
+      {
+        registers[i] = compiled.registers.size();
+        compiled.registers.push_back(values[i]);
+      }
+    }
+    compiled.code.reserve(operations);
+    for (std::size_t i = 0; i < graph.nodes.size(); ++i)
+    {
+      const Node &node = graph.nodes[i];
+      if (node.operation != Operation::symbol && !folded[i])
+      {
+        registers[i] = compiled.registers.size() + compiled.code.size();
+        compiled.code.push_back({node.operation, registers[node.lhs], registers[node.rhs]});
+      }
+    }
+    compiled.root = registers.at(graph.root);
+    return compiled;
+  }
+
+  // the values bound to the symbols of a graph over the sampled evaluations, and which of them changed;
+  // values compare by their bits, so 0.0 and -0.0 differ and a NaN may stay constant
+  struct Value_Profile
+  {
+    std::vector<Tag> symbols;
+    std::vector<double> values; // of the first sample
+    std::vector<bool> varying;
+    std::size_t samples = 0;
+
+    explicit Value_Profile(const Graph &graph)
+    {
+      for (const Node &node : graph.nodes)
+      {
+        if (node.operation == Operation::symbol)
+        {
+          symbols.push_back(node.tag);
+        }
+      }
+      values.resize(symbols.size());
+      varying.resize(symbols.size());
+    }
+
+    void record(std::initializer_list<Binding> bindings)
+    {
+      for (std::size_t i = 0; i < symbols.size(); ++i)
+      {
+        double value = get_binding_value(symbols[i], bindings);
+        if (samples == 0)
+        {
+          values[i] = value;
+        }
+        else if (std::bit_cast<std::uint64_t>(value) != std::bit_cast<std::uint64_t>(values[i]))
+        {
+          varying[i] = true;
+        }
+      }
+      ++samples;
+    }
+
+    // symbols with one value over at least min_samples samples, with that value
+    std::vector<Binding> constants(std::size_t min_samples = 2) const
+    {
+      std::vector<Binding> found;
+      for (std::size_t i = 0; samples >= min_samples && i < symbols.size(); ++i)
+      {
+        if (!varying[i])
+        {
+          found.push_back({symbols[i], values[i]});
+        }
+      }
+      return found;
+    }
+  };
+
+  // the graph with the bound symbols replaced by constants of their values
+  inline Graph specialize_graph(const Graph &graph, const std::vector<Binding> &constants)
+  {
+    Graph specialized;
+    std::vector<std::size_t> map(graph.nodes.size());
+    for (std::size_t i = 0; i < graph.nodes.size(); ++i)
+    {
+      const Node &node = graph.nodes[i];
+      auto bound = std::find_if(constants.begin(), constants.end(), [&node](const Binding &binding)
+                                { return binding.tag == node.tag; });
+      if (node.operation == Operation::symbol && bound != constants.end())
+      {
+        map[i] = specialized.constant(bound->value);
+      }
+      else if (node.operation == Operation::symbol)
+      {
+        map[i] = specialized.symbol(node.tag);
+      }
+      else if (node.operation == Operation::constant)
+      {
+        map[i] = specialized.constant(node.value, node.tag);
+      }
+      else
+      {
+        map[i] = specialized.operation(node.operation, map[node.lhs], map[node.rhs]);
+      }
+    }
+    specialized.root = map.at(graph.root);
+    return specialized;
+  }
+
+  // the generic compiled graph and, when the value profile found constant symbols, one with them folded in,
+  // taken while the bindings still carry the sampled values
+  struct Tiered_Code
+  {
+    Compiled_Graph generic;
+    std::optional<Compiled_Graph> specialized;
+    std::vector<Binding> guards;
+
+    bool guarded(std::initializer_list<Binding> bindings) const
+    {
+      for (const Binding &guard : guards)
+      {
+        if (std::bit_cast<std::uint64_t>(get_binding_value(guard.tag, bindings)) != std::bit_cast<std::uint64_t>(guard.value))
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+  };
+
+  struct Tiering_Options
+  {
+    std::size_t threshold = 256; // interpreted evaluations before the graph is compiled, 0 for only on compile()
+    bool optimize = false;       // run equality saturation before compiling, which may change rounding
+    bool specialize = false;     // profile binding values while interpreted and specialize on the constant ones
+  };
+
+  // evaluates through the interpreter and counts invocations until the threshold, then compiles the graph on
+  // a background thread and publishes it with one atomic store; callers never wait for the compiler, they
+  // keep interpreting until the compiled graph is there. with specialize, the interpreted evaluations also
+  // sample the bound values, skipping a sample rather than waiting when another thread is recording one
+  class Tiered_Graph
+  {
+  public:
+    enum class Tier
+    {
+      interpreted,
+      compiling,
+      compiled,
+      failed // the compiler threw; evaluation stays interpreted
+    };
+
+    explicit Tiered_Graph(Graph graph, const Tiering_Options &options = {}) : graph(std::move(graph)), options(options), profile(this->graph) {}
+
+    Tiered_Graph(const Tiered_Graph &) = delete;
+    Tiered_Graph &operator=(const Tiered_Graph &) = delete;
+
+    double evaluate(std::initializer_list<Binding> bindings)
+    {
+      if (const Tiered_Code *code = compiled.load(std::memory_order_acquire)) [[likely]]
+      {
+        if (code->specialized)
+        {
+          if (code->guarded(bindings)) [[likely]]
+          {
+            return code->specialized->evaluate(bindings);
+          }
+          failed_guards.fetch_add(1, std::memory_order_relaxed);
+        }
+        return code->generic.evaluate(bindings);
+      }
+      if (options.specialize)
+      {
+        if (std::unique_lock lock(profile_mutex, std::try_to_lock); lock.owns_lock())
+        {
+          profile.record(bindings);
+        }
+      }
+      if (invocations.fetch_add(1, std::memory_order_relaxed) + 1 == options.threshold)
+      {
+        compile();
+      }
+      return graph.evaluate(bindings);
+    }
+
+    // starts compiling now, unless it has started already
+    void compile()
+    {
+      Tier expected = Tier::interpreted;
+      if (!state.compare_exchange_strong(expected, Tier::compiling, std::memory_order_relaxed))
+      {
+        return;
+      }
+      compiler = std::jthread([this]
+                              {
+                                try
+                                {
+                                  owner = std::make_unique<Tiered_Code>(build());
+                                  compiled.store(owner.get(), std::memory_order_release);
+                                  state.store(Tier::compiled, std::memory_order_release);
+                                }
+                                catch (...)
+                                {
+                                  state.store(Tier::failed, std::memory_order_release);
+                                }
+                                state.notify_all(); });
+    }
+
+    // compiles if that has not started and blocks until the compiler is done, for startup and tests
+    Tier wait()
+    {
+      compile();
+      Tier current = state.load(std::memory_order_acquire);
+      while (current == Tier::compiling)
+      {
+        state.wait(current, std::memory_order_acquire);
+        current = state.load(std::memory_order_acquire);
+      }
+      return current;
+    }
+
+    Tier tier() const
+    {
+      return state.load(std::memory_order_acquire);
+    }
+
+    std::size_t interpreted_evaluations() const
+    {
+      return invocations.load(std::memory_order_relaxed);
+    }
+
+    // evaluations that took the generic code because a specialized symbol had another value
+    std::size_t guard_failures() const
+    {
+      return failed_guards.load(std::memory_order_relaxed);
+    }
+
+    // the symbols the compiled code is specialized on, with their values; empty before it is compiled
+    std::vector<Binding> specialized_symbols() const
+    {
+      const Tiered_Code *code = compiled.load(std::memory_order_acquire);
+      return code == nullptr ? std::vector<Binding>{} : code->guards;
+    }
+
+    const Graph &source() const
+    {
+      return graph;
+    }
+
+  private:
+    Tiered_Code build()
+    {
+      Graph generic = options.optimize ? symbolic_math::optimize(graph) : graph;
+      Tiered_Code code{compile_graph(generic), std::nullopt, {}};
+      if (options.specialize)
+      {
+        std::lock_guard lock(profile_mutex);
+        code.guards = profile.constants();
+      }
+      if (!code.guards.empty())
+      {
+        code.specialized = compile_graph(specialize_graph(generic, code.guards));
+      }
+      return code;
+    }
+
+    const Graph graph;
+    const Tiering_Options options;
+    std::atomic<std::size_t> invocations{0};
+    std::atomic<std::size_t> failed_guards{0};
+    std::mutex profile_mutex;
+    Value_Profile profile;
+    std::atomic<Tier> state{Tier::interpreted};
+    std::atomic<const Tiered_Code *> compiled{nullptr};
+    std::unique_ptr<Tiered_Code> owner; // written by the compiler before compiled publishes it
+    std::jthread compiler;                 // last, so it is joined before the members it uses are destroyed
+  };
+
+}
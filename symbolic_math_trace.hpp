@@ -0,0 +1,210 @@
+//
+// symbolic_math_trace.hpp
+// scoped trace events of the runtime pipeline, written as chrome trace json
+// compiled out unless SYMBOLIC_MATH_TRACE is defined; load the output in chrome://tracing or ui.perfetto.dev
+//
+// some ideas from https://www.youtube.com/watch?v=lPfA4SFojao
+// created using chatgpt and deepseek, improved by Farshid Mossaiby
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string_view>
+
+namespace symbolic_math
+{
+
+#if defined(SYMBOLIC_MATH_TRACE)
+
+  struct Trace_Event
+  {
+    const char *name;
+    const char *category;
+    std::uint64_t begin; // nanoseconds of the steady clock
+    std::uint64_t duration;
+    std::uint32_t thread; // a buffer outlives its thread and may hold the events of several
+  };
+
+  inline constexpr std::size_t trace_buffer_capacity = 1 << 14;
+
+  // written only by the thread that leases it and published through size, so recording takes no lock; once
+  // full, further events are counted as dropped rather than overwriting what the writer may be reading
+  struct Trace_Buffer
+  {
+    std::array<Trace_Event, trace_buffer_capacity> events;
+    std::atomic<std::size_t> size{0};
+    std::atomic<std::size_t> dropped{0};
+    std::atomic<bool> leased{true};
+    std::uint32_t thread = 0; // of the current lease
+    Trace_Buffer *next = nullptr;
+  };
+
+  inline std::atomic<Trace_Buffer *> &trace_buffers()
+  {
+    static std::atomic<Trace_Buffer *> head{nullptr};
+    return head;
+  }
+
+  // a buffer another thread returned, or a new one pushed onto the lock-free list; buffers are never freed,
+  // so the trace can still be written after the threads that recorded it have ended, but a thread returns
+  // its buffer when it ends, with its events, so the buffers are as many as threads ever traced at once
+  inline Trace_Buffer *lease_trace_buffer()
+  {
+    static std::atomic<std::uint32_t> threads{0};
+    const std::uint32_t thread = threads.fetch_add(1, std::memory_order_relaxed) + 1;
+    for (Trace_Buffer *buffer = trace_buffers().load(std::memory_order_acquire); buffer != nullptr; buffer = buffer->next)
+    {
+      bool leased = false;
+      if (buffer->leased.compare_exchange_strong(leased, true, std::memory_order_acquire, std::memory_order_relaxed))
+      {
+        buffer->thread = thread;
+        return buffer;
+      }
+    }
+    Trace_Buffer *created = new Trace_Buffer;
+    created->thread = thread;
+    created->next = trace_buffers().load(std::memory_order_relaxed);
+    while (!trace_buffers().compare_exchange_weak(created->next, created, std::memory_order_release, std::memory_order_relaxed))
+    {
+    }
+    return created;
+  }
+
+  // returns the buffer on thread exit
+  struct Trace_Lease
+  {
+    Trace_Buffer *buffer = lease_trace_buffer();
+
+    Trace_Lease() = default;
+    Trace_Lease(const Trace_Lease &) = delete;
+    Trace_Lease &operator=(const Trace_Lease &) = delete;
+
+    ~Trace_Lease()
+    {
+      buffer->leased.store(false, std::memory_order_release);
+    }
+  };
+
+  inline Trace_Buffer &thread_trace_buffer()
+  {
+    thread_local Trace_Lease lease;
+    return *lease.buffer;
+  }
+
+  // buffers allocated so far, for tests and diagnostics
+  inline std::size_t trace_buffer_count()
+  {
+    std::size_t count = 0;
+    for (Trace_Buffer *buffer = trace_buffers().load(std::memory_order_acquire); buffer != nullptr; buffer = buffer->next)
+    {
+      ++count;
+    }
+    return count;
+  }
+
+  inline std::uint64_t trace_clock()
+  {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+  }
+
+  inline void record_trace_event(const char *name, const char *category, std::uint64_t begin, std::uint64_t end)
+  {
+    Trace_Buffer &buffer = thread_trace_buffer();
+    std::size_t size = buffer.size.load(std::memory_order_relaxed);
+    if (size == trace_buffer_capacity)
+    {
+      buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    buffer.events[size] = Trace_Event{name, category, begin, end - begin, buffer.thread};
+    buffer.size.store(size + 1, std::memory_order_release);
+  }
+
+  // records one complete event from construction to destruction; name and category must outlive the trace,
+  // string literals in practice
+  class Trace_Scope
+  {
+  public:
+    Trace_Scope(const char *category, const char *name) : name(name), category(category), begin(trace_clock()) {}
+
+    ~Trace_Scope()
+    {
+      record_trace_event(name, category, begin, trace_clock());
+    }
+
+    Trace_Scope(const Trace_Scope &) = delete;
+    Trace_Scope &operator=(const Trace_Scope &) = delete;
+
+  private:
+    const char *name;
+    const char *category;
+    std::uint64_t begin;
+  };
+
+#define SYMBOLIC_MATH_TRACE_CONCATENATE_(a, b) a##b
+#define SYMBOLIC_MATH_TRACE_CONCATENATE(a, b) SYMBOLIC_MATH_TRACE_CONCATENATE_(a, b)
+#define SYMBOLIC_MATH_TRACE_SCOPE(category, name) \
+  ::symbolic_math::Trace_Scope SYMBOLIC_MATH_TRACE_CONCATENATE(symbolic_math_trace_scope_, __LINE__)(category, name)
+
+  inline void write_trace_string(std::ostream &out, std::string_view text)
+  {
+    out << '"';
+    for (char c : text)
+    {
+      if (c == '"' || c == '\\')
+      {
+        out << '\\';
+      }
+      out << c;
+    }
+    out << '"';
+  }
+
+  // every event recorded so far, as complete ("X") events with microsecond timestamps
+  inline void write_chrome_trace(std::ostream &out)
+  {
+    std::size_t dropped = 0;
+    bool first = true;
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3) << "{\"traceEvents\": [";
+    for (Trace_Buffer *buffer = trace_buffers().load(std::memory_order_acquire); buffer != nullptr; buffer = buffer->next)
+    {
+      std::size_t size = buffer->size.load(std::memory_order_acquire);
+      dropped += buffer->dropped.load(std::memory_order_relaxed);
+      for (std::size_t i = 0; i < size; ++i)
+      {
+        const Trace_Event &event = buffer->events[i];
+        out << (first ? "\n  {" : ",\n  {") << "\"name\": ";
+        write_trace_string(out, event.name);
+        out << ", \"cat\": ";
+        write_trace_string(out, event.category);
+        out << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread << ", \"ts\": " << static_cast<double>(event.begin) / 1000.0
+            << ", \"dur\": " << static_cast<double>(event.duration) / 1000.0 << "}";
+        first = false;
+      }
+    }
+    out << "\n], \"displayTimeUnit\": \"ns\", \"otherData\": {\"dropped_events\": \"" << dropped << "\"}}\n";
+    out.flags(flags);
+    out.precision(precision);
+  }
+
+#else
+
+#define SYMBOLIC_MATH_TRACE_SCOPE(category, name) static_cast<void>(0)
+
+  inline void write_chrome_trace(std::ostream &out)
+  {
+    out << "{\"traceEvents\": []}\n";
+  }
+
+#endif
+
+}